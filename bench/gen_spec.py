@@ -0,0 +1,58 @@
+#!/usr/bin/env python3
+"""Writes a synthetic .lexy spec with the given number of rules to stdout.
+
+Usage: gen_spec.py RULES [SEED]
+
+The rules mix keywords, prefixed identifiers, suffixed identifiers and
+numeric literals that overlap with each other and with a trailing
+IDENTIFIER rule, which makes for DFAs with many states that minimization
+can merge. The same RULES and SEED always give the same spec.
+"""
+
+import random
+import sys
+
+LETTERS = 'abcdefghijklmnopqrstuvwxyz'
+
+
+def word(low, high):
+    return ''.join(random.choice(LETTERS)
+                   for _ in range(random.randint(low, high)))
+
+
+def main():
+    if len(sys.argv) < 2:
+        sys.exit(__doc__.strip())
+    rule_count = int(sys.argv[1])
+    random.seed(int(sys.argv[2]) if len(sys.argv) > 2 else 1)
+
+    rules = []
+    seen = set()
+    i = 0
+    while len(rules) < rule_count - 4:
+        kind = random.random()
+        if kind < 0.1:
+            rules.append(f'S{i} ::= "[a-z]+_{word(2, 5)}"')
+        elif kind < 0.6:
+            keyword = word(3, 10)
+            if keyword in seen:
+                continue
+            seen.add(keyword)
+            rules.append(f'KW{i} ::= "{keyword}"')
+        elif kind < 0.85:
+            rules.append(f'P{i} ::= "{word(2, 4)}_[a-z]+[0-9]*"')
+        else:
+            first = random.choice(LETTERS)
+            second = random.choice(LETTERS)
+            rules.append(f'R{i} ::= "{first}{second}?[0-9]+(\\.[0-9]+)?"')
+        i += 1
+
+    rules.append('IDENTIFIER ::= "[a-zA-Z_][a-zA-Z0-9_]*"')
+    rules.append('INTEGER ::= "[0-9]+"')
+    rules.append('FLOAT ::= "[0-9]+\\.[0-9]+"')
+    rules.append('WHITESPACE ::= "[ \\t\\n]+"')
+    print('\n'.join(rules))
+
+
+if __name__ == '__main__':
+    main()
@@ -1,6 +1,8 @@
 #include "src/automata/dfa.hpp"
 #include "src/automata/dfa_minimizer.hpp"
+#include "src/automata/keyword_extractor.hpp"
 #include "src/automata/nfa_determinizer.hpp"
+#include "src/automata/nfa_optimizer.hpp"
 #include "src/automata/thompson_construction.hpp"
 #include "src/code_generation/code_generator.hpp"
 #include "src/common/helpers.hpp"
@@ -24,6 +26,14 @@ void printUsage(const char *progName) {
        << "  -o <dir>     Output directory for generated files (default: "
           "./output)\n"
        << "  -g           Enable automata graph generation\n"
+       << "  -b <backend> Scanner backend: table (default), direct, sheng or "
+          "stride2\n"
+       << "  -s           Generate a scanner that expects a zero byte after "
+          "its input\n"
+       << "  -l           Generate a scanner that runs in linear time on any "
+          "input\n"
+       << "  -k           Keep keyword rules in the DFA instead of looking "
+          "them up\n"
        << "  -h           Show this help message\n";
 }
 
@@ -31,9 +41,11 @@ int main(int argc, char *argv[]) {
   String input_filename;
   String output_dir = "output";
   bool generate_graphs = false;
+  bool extract_keywords = true;
+  GeneratorOptions generator_options;
 
   int opt;
-  while ((opt = getopt(argc, argv, "o:gh")) != -1) {
+  while ((opt = getopt(argc, argv, "o:gb:slkh")) != -1) {
     switch (opt) {
     case 'o':
       output_dir = optarg;
@@ -41,6 +53,30 @@ int main(int argc, char *argv[]) {
     case 'g':
       generate_graphs = true;
       break;
+    case 'b':
+      if (String(optarg) == "table") {
+        generator_options.backend = Backend::TABLE;
+      } else if (String(optarg) == "direct") {
+        generator_options.backend = Backend::DIRECT;
+      } else if (String(optarg) == "sheng") {
+        generator_options.backend = Backend::SHENG;
+      } else if (String(optarg) == "stride2") {
+        generator_options.backend = Backend::STRIDE2;
+      } else {
+        cerr << "Error: Unknown backend '" << optarg << "'.\n";
+        printUsage(argv[0]);
+        return -1;
+      }
+      break;
+    case 's':
+      generator_options.sentinel = true;
+      break;
+    case 'l':
+      generator_options.linear = true;
+      break;
+    case 'k':
+      extract_keywords = false;
+      break;
     case 'h':
       printUsage(argv[0]);
       return 0;
@@ -85,6 +121,7 @@ int main(int argc, char *argv[]) {
 
   Vector<String> token_types;
   Vector<NFA> nfas;
+  Vector<String> literals;
 
   // Map each token type to its declaration index for use by the determinizer
   // when it must break ties between multiple accepting NFA states.
@@ -101,10 +138,46 @@ int main(int argc, char *argv[]) {
     NFA nfa = RegexASTToNFA::convert(regex_ast, token_type);
     nfas.push_back(nfa);
     token_types.push_back(token_type);
+    literals.push_back(KeywordExtractor::literalOf(regex_ast.get()));
+  }
+
+  // Keywords that an identifier-like rule also matches are left out of the
+  // automaton; the generated scanner looks them up after a match instead
+  Vector<Keyword> keywords;
+  if (extract_keywords) {
+    keywords = KeywordExtractor::extract(token_types, nfas, literals);
+  }
+
+  Set<String> keyword_types;
+  for (const Keyword &keyword : keywords) {
+    cout << "Keyword: " << keyword.token_type << " is looked up after "
+         << keyword.base_token_type << endl;
+    keyword_types.insert(keyword.token_type);
+  }
+
+  Vector<NFA> automaton_nfas;
+  for (Index i = 0; i < nfas.size(); i++) {
+    if (keyword_types.find(token_types[i]) == keyword_types.end()) {
+      automaton_nfas.push_back(nfas[i]);
+    }
   }
 
-  NFA merged_nfa = ThompsonConstruction::mergeAll(nfas);
-  DFA dfa = NFADeterminizer::determinize(merged_nfa, token_priority);
+  NFA merged_nfa = ThompsonConstruction::mergeAll(automaton_nfas);
+
+  // Subset construction works on the epsilon-free, pruned and merged NFA
+  NFA optimized_nfa = NFAOptimizer::optimize(merged_nfa, token_priority);
+  NFASize merged_size = NFAOptimizer::measure(merged_nfa);
+  NFASize optimized_size = NFAOptimizer::measure(optimized_nfa);
+  cout << "NFA: " << merged_size.states << " states, "
+       << merged_size.transitions << " transitions, "
+       << merged_size.epsilon_transitions << " epsilon transitions -> "
+       << optimized_size.states << " states, " << optimized_size.transitions
+       << " transitions, " << optimized_size.epsilon_transitions
+       << " epsilon transitions" << endl;
+
+  DFA dfa = NFADeterminizer::determinize(optimized_nfa, token_priority);
+  cout << "Symbol classes: " << dfa.getSymbolClasses().size() << " for "
+       << optimized_nfa.getAlphabet().size() << " symbols" << endl;
   DFA minimized = DFAMinimizer::minimize(dfa);
 
   // Initialize output directory structure
@@ -122,6 +195,9 @@ int main(int argc, char *argv[]) {
     AutomataVisualizer::visualizeNFA(merged_nfa,
                                      (graphviz_path / "nfa").string(),
                                      (images_path / "nfa").string());
+    AutomataVisualizer::visualizeNFA(
+        optimized_nfa, (graphviz_path / "nfa_optimized").string(),
+        (images_path / "nfa_optimized").string());
     AutomataVisualizer::visualizeDFA(dfa, (graphviz_path / "dfa").string(),
                                      (images_path / "dfa").string());
     AutomataVisualizer::visualizeDFA(minimized,
@@ -138,7 +214,8 @@ int main(int argc, char *argv[]) {
   String base_name = getBaseName(input_filename);
   String output_filename = (scanner_path / (base_name + ".cpp")).string();
 
-  CodeGenerator::generateScanner(minimized, token_types, output_filename);
+  CodeGenerator::generateScanner(minimized, token_types, output_filename,
+                                 generator_options, keywords);
 
   cout << "\nScanner generated successfully in: " << output_filename << endl;
   return 0;
@@ -0,0 +1,113 @@
+#include "backtrack_analyzer.hpp"
+#include "dfa.hpp"
+#include "fa_state.hpp"
+#include <algorithm>
+
+BacktrackReport BacktrackAnalyzer::analyze(const DFA &dfa) {
+  Alphabet alphabet = dfa.getAlphabet();
+
+  // Collect the non-accepting states reachable from any accepting state, and
+  // the ones among them entered directly from an accepting state
+  Set<StateID> offending;
+  Set<StateID> entries;
+  Queue<StateID> to_visit;
+
+  for (const State &state : dfa.getStates()) {
+    StateID id = state.getID();
+    if (!dfa.isAccepting(id))
+      continue;
+
+    for (Symbol symbol : alphabet) {
+      StateID next = dfa.getNextState(id, symbol);
+      if (next == -1 || dfa.isAccepting(next))
+        continue;
+      entries.insert(next);
+      if (offending.insert(next).second)
+        to_visit.push(next);
+    }
+  }
+
+  while (!to_visit.empty()) {
+    StateID current = to_visit.front();
+    to_visit.pop();
+
+    for (Symbol symbol : alphabet) {
+      StateID next = dfa.getNextState(current, symbol);
+      if (next != -1 && !dfa.isAccepting(next) &&
+          offending.insert(next).second)
+        to_visit.push(next);
+    }
+  }
+
+  BacktrackReport report;
+  report.offending_states.assign(offending.begin(), offending.end());
+
+  // The distance is the longest run of offending states a walk can cross
+  // after its last accepting state
+  Map<StateID, int> memo;
+  for (StateID entry : entries) {
+    int length = longestPath(dfa, alphabet, entry, offending, memo);
+    if (length == -1) {
+      report.max_distance = -1;
+      break;
+    }
+    report.max_distance = std::max(report.max_distance, length);
+  }
+
+  return report;
+}
+
+// Returns the number of states on the longest path from state that stays
+// within offending, or -1 if such a path can loop. memo holds 0 for states on
+// the current path. The depth-first search keeps its own stack, since a path
+// through a large DFA can be deeper than the call stack.
+int BacktrackAnalyzer::longestPath(const DFA &dfa, const Alphabet &alphabet,
+                                   StateID state,
+                                   const Set<StateID> &offending,
+                                   Map<StateID, int> &memo) {
+  auto it = memo.find(state);
+  if (it != memo.end())
+    return it->second == 0 ? -1 : it->second;
+
+  // A state on the current path, the next of its symbols to follow and the
+  // longest path found so far from its successors
+  struct Step {
+    StateID state;
+    Alphabet::const_iterator symbol;
+    int longest;
+  };
+  Vector<Step> path{{state, alphabet.begin(), 0}};
+  memo[state] = 0;
+  int length = 0;
+
+  while (!path.empty()) {
+    Step &step = path.back();
+
+    if (step.symbol != alphabet.end()) {
+      StateID next = dfa.getNextState(step.state, *step.symbol++);
+      if (next == -1 || offending.find(next) == offending.end())
+        continue;
+
+      auto found = memo.find(next);
+      if (found == memo.end()) {
+        memo[next] = 0;
+        path.push_back({next, alphabet.begin(), 0});
+      } else if (found->second <= 0) {
+        for (const Step &on_path : path)
+          memo[on_path.state] = -1;
+        return -1;
+      } else {
+        step.longest = std::max(step.longest, found->second);
+      }
+      continue;
+    }
+
+    length = step.longest + 1;
+    memo[step.state] = length;
+    path.pop_back();
+    if (!path.empty())
+      path.back().longest = std::max(path.back().longest, length);
+  }
+
+  return length;
+}
@@ -0,0 +1,25 @@
+#pragma once
+
+#include "../common/types.hpp"
+#include "dfa.hpp"
+
+// A scanner only has to remember its last accepting state and position when
+// a walk can leave an accepting state, enter non-accepting ones and then die.
+struct BacktrackReport {
+  // Non-accepting states that can be entered after an accepting state
+  StateIDs offending_states;
+  // Most bytes a failed match can consume past its last accepting state, or
+  // -1 when the offending states form a cycle
+  int max_distance = 0;
+
+  bool isBacktrackFree() const { return offending_states.empty(); }
+};
+
+class BacktrackAnalyzer {
+public:
+  static BacktrackReport analyze(const DFA &);
+
+private:
+  static int longestPath(const DFA &, const Alphabet &, StateID,
+                         const Set<StateID> &, Map<StateID, int> &);
+};
@@ -1,7 +1,7 @@
 #include "dfa.hpp"
 
 void DFA::addTransition(StateID from, Symbol symbol, StateID to) {
-  transitions_[from][symbol] = to;
+  transitions_[from][symbol_classes_.getRepresentative(symbol)] = to;
 }
 
 void DFA::resizeTransitions(Size new_size) { transitions_.resize(new_size); }
@@ -11,7 +11,8 @@ StateID DFA::getNextState(StateID from, Symbol symbol) const {
     return -1;
   }
 
-  auto iterator = transitions_[from].find(symbol);
+  auto iterator =
+      transitions_[from].find(symbol_classes_.getRepresentative(symbol));
   if (iterator == transitions_[from].end()) {
     return -1;
   }
@@ -2,10 +2,14 @@
 
 #include "../common/types.hpp"
 #include "fa.hpp"
+#include "symbol_classes.hpp"
 
 class DFA : public FA {
 private:
+  // Keyed by class representative; every other symbol of a class is looked
+  // up through its representative
   Vector<UnorderedMap<Symbol, StateID>> transitions_;
+  SymbolClasses symbol_classes_;
 
 public:
   DFA(const Alphabet &alphabet, const States &states,
@@ -18,4 +22,10 @@ public:
   void resizeTransitions(Size);
 
   StateID getNextState(StateID, Symbol) const;
+
+  const SymbolClasses &getSymbolClasses() const { return symbol_classes_; }
+  // Only valid before any transition is added
+  void setSymbolClasses(const SymbolClasses &symbol_classes) {
+    symbol_classes_ = symbol_classes;
+  }
 };
@@ -3,156 +3,250 @@
 #include "fa_state.hpp"
 
 DFA DFAMinimizer::minimize(const DFA &dfa) {
-  // Find reachable states
-  Set<StateID> reachable;
-  Queue<StateID> to_visit;
-
-  StateID start = dfa.getStartStateID();
-  reachable.insert(start);
-  to_visit.push(start);
-
-  Alphabet alphabet = dfa.getAlphabet();
-
-  while (!to_visit.empty()) {
-    StateID current = to_visit.front();
-    to_visit.pop();
+  StateIDs reachable = reachableStates(dfa);
+  // Members of a symbol class always share their target, so checking one
+  // symbol per class is enough
+  const Symbols &symbols = dfa.getSymbolClasses().getRepresentatives();
+
+  // Work on dense indices. The extra state `sink` stands for every missing
+  // transition, which makes the DFA complete as Hopcroft's algorithm needs.
+  Size state_count = reachable.size() + 1;
+  StateID sink = static_cast<StateID>(reachable.size());
+  Vector<StateID> dense_id(dfa.getStates().size(), -1);
+  for (Index i = 0; i < reachable.size(); i++) {
+    dense_id[reachable[i]] = static_cast<StateID>(i);
+  }
 
-    for (Symbol symbol : alphabet) {
-      StateID next = dfa.getNextState(current, symbol);
-      if (next != -1 && reachable.find(next) == reachable.end()) {
-        reachable.insert(next);
-        to_visit.push(next);
-      }
+  // Predecessors of state t on symbol class c are
+  // sources[begin[c * state_count + t] .. begin[c * state_count + t + 1])
+  Size symbol_count = symbols.size();
+  StateIDs targets(symbol_count * state_count);
+  for (Index c = 0; c < symbol_count; c++) {
+    for (StateID q = 0; q < sink; q++) {
+      StateID next = dfa.getNextState(reachable[q], symbols[c]);
+      targets[c * state_count + q] = next == -1 ? sink : dense_id[next];
     }
+    targets[c * state_count + sink] = sink;
   }
 
-  // Create initial partitions (accepting vs non-accepting)
-  // Only include reachable states
-  Vector<Superstate> partitions;
-  Superstate nonaccepting_partition;
-  Map<String, Superstate> accepting_partitions;
-
-  for (const State &state : dfa.getStates()) {
-    StateID id = state.getID();
-    // Only consider reachable states
-    if (reachable.find(id) == reachable.end()) {
-      continue;
+  Vector<Index> begin(symbol_count * state_count + 1, 0);
+  for (Index c = 0; c < symbol_count; c++) {
+    for (StateID q = 0; q <= sink; q++) {
+      begin[c * state_count + targets[c * state_count + q] + 1]++;
+    }
+  }
+  for (Index i = 1; i < begin.size(); i++) {
+    begin[i] += begin[i - 1];
+  }
+  StateIDs sources(symbol_count * state_count);
+  Vector<Index> next_slot(begin.begin(), begin.end() - 1);
+  for (Index c = 0; c < symbol_count; c++) {
+    for (StateID q = 0; q <= sink; q++) {
+      sources[next_slot[c * state_count + targets[c * state_count + q]]++] = q;
     }
+  }
 
-    if (dfa.isAccepting(id)) {
-      accepting_partitions[dfa.getTokenType(id)].insert(id);
-    } else {
-      nonaccepting_partition.insert(id);
+  // The initial blocks are the non-accepting states, sink included, and one
+  // block per token type
+  Partition partition;
+  Map<String, StateID> block_of_token;
+  StateIDs initial_block(state_count);
+  Vector<Index> block_size;
+  for (StateID q = 0; q <= sink; q++) {
+    bool accepting = q != sink && dfa.isAccepting(reachable[q]);
+    String key = accepting ? dfa.getTokenType(reachable[q]) : String();
+    key.insert(key.begin(), accepting ? '+' : '-');
+    auto [it, inserted] = block_of_token.insert(
+        {key, static_cast<StateID>(block_of_token.size())});
+    if (inserted) {
+      block_size.push_back(0);
     }
+    initial_block[q] = it->second;
+    block_size[it->second]++;
   }
 
-  if (!nonaccepting_partition.empty()) {
-    partitions.push_back(nonaccepting_partition);
+  Size block_count = block_size.size();
+  partition.location.resize(state_count);
+  partition.block_of = initial_block;
+  partition.marked.assign(block_count, 0);
+  for (Index b = 0, offset = 0; b < block_count; b++) {
+    partition.block_begin.push_back(offset);
+    partition.block_end.push_back(offset);
+    offset += block_size[b];
   }
-  for (auto const &[token_type, partition] : accepting_partitions) {
-    partitions.push_back(partition);
+  partition.elements.resize(state_count);
+  for (StateID q = 0; q <= sink; q++) {
+    Index &end = partition.block_end[initial_block[q]];
+    partition.elements[end] = q;
+    partition.location[q] = end++;
   }
 
-  // Refine partitions until no more splits occur
-  bool changed = true;
-  while (changed) {
-    changed = false;
-    Vector<Superstate> new_partitions;
-
-    for (const Superstate &partition : partitions) {
-      // For each partition, try to split it
-      Map<Vector<int>, Superstate> signature_to_states;
-
-      for (StateID state_id : partition) {
-        // Create signature: for each symbol, which partition does it go to?
-        Vector<int> signature;
-
-        for (Symbol symbol : alphabet) {
-          StateID next_state = dfa.getNextState(state_id, symbol);
-
-          // Find which partition contains next_state
-          int target_partition_index = -1;
-          if (next_state != -1) {
-            for (Index i = 0; i < partitions.size(); i++) {
-              if (partitions[i].find(next_state) != partitions[i].end()) {
-                target_partition_index = static_cast<int>(i);
-                break;
-              }
-            }
-          }
+  // Every block but the largest starts out as a splitter; refining by all
+  // of them also refines by the largest
+  StateIDs worklist;
+  Vector<bool> in_worklist(block_count, false);
+  Index largest = 0;
+  for (Index b = 1; b < block_count; b++) {
+    if (block_size[b] > block_size[largest]) {
+      largest = b;
+    }
+  }
+  for (Index b = 0; b < block_count; b++) {
+    if (b != largest) {
+      worklist.push_back(static_cast<StateID>(b));
+      in_worklist[b] = true;
+    }
+  }
 
-          signature.push_back(target_partition_index);
+  StateIDs splitter;
+  StateIDs touched_blocks;
+  while (!worklist.empty()) {
+    StateID block = worklist.back();
+    worklist.pop_back();
+    in_worklist[block] = false;
+
+    // The block itself may be split below, so refine by a copy of it
+    splitter.assign(partition.elements.begin() + partition.block_begin[block],
+                    partition.elements.begin() + partition.block_end[block]);
+
+    for (Index c = 0; c < symbol_count; c++) {
+      for (StateID target : splitter) {
+        for (Index i = begin[c * state_count + target];
+             i < begin[c * state_count + target + 1]; i++) {
+          mark(partition, sources[i], touched_blocks);
         }
-
-        // Group states with same signature
-        signature_to_states[signature].insert(state_id);
       }
 
-      // If we have multiple groups, the partition was split
-      if (signature_to_states.size() > 1) {
-        changed = true;
-        for (const auto &[signature, states] : signature_to_states) {
-          new_partitions.push_back(states);
+      for (StateID touched : touched_blocks) {
+        StateID new_block = split(partition, touched);
+        if (new_block == -1) {
+          continue;
         }
-      } else {
-        // No split, keep the partition as is
-        new_partitions.push_back(partition);
+
+        // Once a block is split, refining by either half and by the old
+        // block is as good as refining by both halves, so the smaller half
+        // is enough unless the old block was still waiting
+        in_worklist.push_back(false);
+        Size new_size = partition.block_end[new_block] -
+                        partition.block_begin[new_block];
+        Size old_size =
+            partition.block_end[touched] - partition.block_begin[touched];
+        StateID added = in_worklist[touched] || new_size <= old_size
+                            ? new_block
+                            : touched;
+        worklist.push_back(added);
+        in_worklist[added] = true;
       }
+      touched_blocks.clear();
     }
-
-    partitions = new_partitions;
   }
 
-  // Build the minimized DFA
-  // Create mapping from old state ID to new partition ID
-  Map<StateID, StateID> old_to_new_state;
-  for (Index i = 0; i < partitions.size(); i++) {
-    for (StateID old_id : partitions[i]) {
-      old_to_new_state[old_id] = static_cast<StateID>(i);
+  // Number the blocks in order of their first reachable state, leaving out
+  // the block of states that behave like the sink unless the start state is
+  // in it
+  StateID start = dense_id[dfa.getStartStateID()];
+  StateID dead_block = partition.block_of[sink];
+  StateIDs new_id(partition.block_begin.size(), -1);
+  StateIDs representatives;
+  for (StateID q = 0; q < sink; q++) {
+    StateID block = partition.block_of[q];
+    if (new_id[block] != -1 || (block == dead_block && q != start)) {
+      continue;
     }
+    new_id[block] = static_cast<StateID>(representatives.size());
+    representatives.push_back(q);
   }
 
-  // Find new initial state
-  StateID old_initial = dfa.getStartStateID();
-  StateID new_initial = old_to_new_state[old_initial];
-
-  // Build new states and accepting states
   States minimized_states;
   UnorderedMap<StateID, String> minimized_accepting_map;
-
-  for (Index i = 0; i < partitions.size(); i++) {
+  for (Index i = 0; i < representatives.size(); i++) {
     minimized_states.push_back(State{static_cast<int>(i)});
 
-    // Check if this partition contains an accepting state
-    // If so, use the token type from that accepting state
-    for (StateID old_id : partitions[i]) {
-      if (dfa.isAccepting(old_id)) {
-        String token_type = dfa.getTokenType(old_id);
-        minimized_accepting_map[static_cast<StateID>(i)] = token_type;
-        break;
-      }
+    StateID original = reachable[representatives[i]];
+    if (dfa.isAccepting(original)) {
+      minimized_accepting_map[static_cast<StateID>(i)] =
+          dfa.getTokenType(original);
     }
   }
 
-  // Build minimized DFA
-  DFA minimized_dfa{alphabet, minimized_states, minimized_accepting_map,
-                    new_initial};
-  minimized_dfa.resizeTransitions(partitions.size());
-
-  // Build transitions using a representative from each partition
-  for (Index i = 0; i < partitions.size(); i++) {
-    StateID representative = *partitions[i].begin();
+  DFA minimized_dfa{dfa.getAlphabet(), minimized_states,
+                    minimized_accepting_map,
+                    new_id[partition.block_of[start]]};
+  minimized_dfa.setSymbolClasses(dfa.getSymbolClasses());
+  minimized_dfa.resizeTransitions(representatives.size());
+
+  for (Index i = 0; i < representatives.size(); i++) {
+    for (Index c = 0; c < symbol_count; c++) {
+      StateID target = targets[c * state_count + representatives[i]];
+      StateID block = partition.block_of[target];
+      if (block != dead_block) {
+        minimized_dfa.addTransition(static_cast<StateID>(i), symbols[c],
+                                    new_id[block]);
+      }
+    }
+  }
 
-    for (Symbol symbol : alphabet) {
-      StateID old_target = dfa.getNextState(representative, symbol);
+  return minimized_dfa;
+}
 
-      if (old_target != -1) {
-        StateID new_target = old_to_new_state[old_target];
-        minimized_dfa.addTransition(static_cast<StateID>(i), symbol,
-                                    new_target);
+StateIDs DFAMinimizer::reachableStates(const DFA &dfa) {
+  const Symbols &symbols = dfa.getSymbolClasses().getRepresentatives();
+  Vector<bool> visited(dfa.getStates().size(), false);
+  StateIDs reachable{dfa.getStartStateID()};
+  visited[dfa.getStartStateID()] = true;
+
+  for (Index i = 0; i < reachable.size(); i++) {
+    for (Symbol symbol : symbols) {
+      StateID next = dfa.getNextState(reachable[i], symbol);
+      if (next != -1 && !visited[next]) {
+        visited[next] = true;
+        reachable.push_back(next);
       }
     }
   }
 
-  return minimized_dfa;
+  return reachable;
+}
+
+void DFAMinimizer::mark(Partition &partition, StateID state,
+                        StateIDs &touched_blocks) {
+  StateID block = partition.block_of[state];
+  Index first_unmarked = partition.block_begin[block] + partition.marked[block];
+  Index position = partition.location[state];
+  if (position < first_unmarked) {
+    return;
+  }
+
+  // Swap the state into the marked front of its block
+  StateID other = partition.elements[first_unmarked];
+  partition.elements[position] = other;
+  partition.location[other] = position;
+  partition.elements[first_unmarked] = state;
+  partition.location[state] = first_unmarked;
+
+  if (partition.marked[block]++ == 0) {
+    touched_blocks.push_back(block);
+  }
+}
+
+StateID DFAMinimizer::split(Partition &partition, StateID block) {
+  Index first = partition.block_begin[block];
+  Index marked_end = first + partition.marked[block];
+  partition.marked[block] = 0;
+
+  if (marked_end == partition.block_end[block]) {
+    return -1;
+  }
+
+  StateID new_block = static_cast<StateID>(partition.block_begin.size());
+  partition.block_begin.push_back(first);
+  partition.block_end.push_back(marked_end);
+  partition.marked.push_back(0);
+  partition.block_begin[block] = marked_end;
+
+  for (Index i = first; i < marked_end; i++) {
+    partition.block_of[partition.elements[i]] = new_block;
+  }
+
+  return new_block;
 }
@@ -5,7 +5,29 @@
 
 class DFAMinimizer {
 public:
+  // Returns the smallest DFA with the same language and token types, found
+  // with Hopcroft's partition refinement in O(n k log n) time for n states
+  // and k symbol classes. Unreachable states are dropped, and so are states
+  // from which no accepting state can be reached, together with the
+  // transitions into them.
   static DFA minimize(const DFA &);
 
 private:
+  // Blocks of states stored as ranges of one array. The marked states of a
+  // block sit at the front of its range, so splitting a block off is moving
+  // its range start past them.
+  struct Partition {
+    StateIDs elements;
+    Vector<Index> location;
+    StateIDs block_of;
+    Vector<Index> block_begin;
+    Vector<Index> block_end;
+    Vector<Index> marked;
+  };
+
+  static StateIDs reachableStates(const DFA &);
+  static void mark(Partition &, StateID, StateIDs &touched_blocks);
+  // Moves the marked states of block into a new block and returns its ID,
+  // or -1 when every state of block is marked
+  static StateID split(Partition &, StateID block);
 };
@@ -0,0 +1,91 @@
+#include "dfa_renumberer.hpp"
+#include "dfa.hpp"
+#include "fa_state.hpp"
+#include <algorithm>
+
+DFA DFARenumberer::renumber(const DFA &dfa) {
+  StateIDs order = breadthFirstOrder(dfa);
+
+  // Non-accepting states first, then accepting ones
+  std::stable_partition(order.begin(), order.end(), [&](StateID id) {
+    return !dfa.isAccepting(id);
+  });
+
+  Vector<StateID> old_to_new_state(dfa.getStates().size(), -1);
+  for (Index i = 0; i < order.size(); i++) {
+    old_to_new_state[order[i]] = static_cast<StateID>(i);
+  }
+
+  States renumbered_states;
+  UnorderedMap<StateID, String> renumbered_accepting_map;
+  for (Index i = 0; i < order.size(); i++) {
+    renumbered_states.push_back(State{static_cast<int>(i)});
+    if (dfa.isAccepting(order[i])) {
+      renumbered_accepting_map[static_cast<StateID>(i)] =
+          dfa.getTokenType(order[i]);
+    }
+  }
+
+  DFA renumbered_dfa{dfa.getAlphabet(), renumbered_states,
+                     renumbered_accepting_map,
+                     old_to_new_state[dfa.getStartStateID()]};
+  renumbered_dfa.setSymbolClasses(dfa.getSymbolClasses());
+  renumbered_dfa.resizeTransitions(order.size());
+
+  const Symbols &symbols = dfa.getSymbolClasses().getRepresentatives();
+  for (Index i = 0; i < order.size(); i++) {
+    for (Symbol symbol : symbols) {
+      StateID old_target = dfa.getNextState(order[i], symbol);
+      if (old_target != -1) {
+        renumbered_dfa.addTransition(static_cast<StateID>(i), symbol,
+                                     old_to_new_state[old_target]);
+      }
+    }
+  }
+
+  return renumbered_dfa;
+}
+
+Size DFARenumberer::countNonAccepting(const DFA &dfa) {
+  Size count = 0;
+  for (const State &state : dfa.getStates()) {
+    if (!dfa.isAccepting(state.getID()))
+      count++;
+  }
+  return count;
+}
+
+// Visits the start state first, then every state reachable from it, then any
+// unreachable states in ID order
+StateIDs DFARenumberer::breadthFirstOrder(const DFA &dfa) {
+  Size num_states = dfa.getStates().size();
+  Vector<bool> visited(num_states, false);
+  StateIDs order;
+  Queue<StateID> to_visit;
+  const Symbols &symbols = dfa.getSymbolClasses().getRepresentatives();
+
+  StateID start = dfa.getStartStateID();
+  visited[start] = true;
+  to_visit.push(start);
+
+  while (!to_visit.empty()) {
+    StateID current = to_visit.front();
+    to_visit.pop();
+    order.push_back(current);
+
+    for (Symbol symbol : symbols) {
+      StateID next = dfa.getNextState(current, symbol);
+      if (next != -1 && !visited[next]) {
+        visited[next] = true;
+        to_visit.push(next);
+      }
+    }
+  }
+
+  for (const State &state : dfa.getStates()) {
+    if (!visited[state.getID()])
+      order.push_back(state.getID());
+  }
+
+  return order;
+}
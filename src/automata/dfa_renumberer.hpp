@@ -0,0 +1,18 @@
+#pragma once
+
+#include "../common/types.hpp"
+#include "dfa.hpp"
+
+class DFARenumberer {
+public:
+  // Returns an equivalent DFA whose non-accepting states come first and whose
+  // accepting states occupy the IDs from countNonAccepting() up, so that "is
+  // accepting" becomes a single comparison. Within each group states keep
+  // breadth-first order from the start state.
+  static DFA renumber(const DFA &);
+
+  static Size countNonAccepting(const DFA &);
+
+private:
+  static StateIDs breadthFirstOrder(const DFA &);
+};
@@ -0,0 +1,148 @@
+#include "epsilon_closures.hpp"
+#include <algorithm>
+#include <bit>
+
+// Condenses the epsilon graph with Tarjan's algorithm and gives each
+// component the closure of its states. Tarjan finishes a component only after
+// every component reachable from it, so a closure is the component's own
+// states plus the closures of its successors, all of which already exist.
+// The depth-first search keeps its own stack, since a chain of epsilon moves
+// in a large NFA can be deeper than the call stack.
+EpsilonClosures::EpsilonClosures(const NFA &nfa) {
+  Size state_count = nfa.getStates().size();
+
+  // Epsilon edges of state s are epsilon_targets[epsilon_begin[s] ..
+  // epsilon_begin[s + 1])
+  Vector<Index> epsilon_begin;
+  StateIDs epsilon_targets;
+  for (Index state_id = 0; state_id < state_count; state_id++) {
+    epsilon_begin.push_back(epsilon_targets.size());
+    for (StateID next_state_id : nfa.getEpsilonNextStatesIDs(state_id)) {
+      epsilon_targets.push_back(next_state_id);
+    }
+  }
+  epsilon_begin.push_back(epsilon_targets.size());
+
+  StateIDs order(state_count, -1);
+  StateIDs lowlink(state_count, 0);
+  Vector<bool> on_stack(state_count, false);
+  StateIDs component_stack;
+  // A state being visited and the next of its epsilon edges to follow
+  Vector<Pair<StateID, Index>> search;
+  StateID next_order = 0;
+
+  Vector<bool> in_closure(state_count, false);
+  component_.assign(state_count, -1);
+  in_closure_.assign((state_count + 63) / 64, 0);
+
+  auto visit = [&](StateID state_id) {
+    order[state_id] = lowlink[state_id] = next_order++;
+    component_stack.push_back(state_id);
+    on_stack[state_id] = true;
+    search.push_back({state_id, epsilon_begin[state_id]});
+  };
+
+  for (StateID root = 0; root < static_cast<StateID>(state_count); root++) {
+    if (order[root] != -1) {
+      continue;
+    }
+    visit(root);
+
+    while (!search.empty()) {
+      StateID state_id = search.back().first;
+      Index &edge = search.back().second;
+
+      if (edge < epsilon_begin[state_id + 1]) {
+        StateID next_state_id = epsilon_targets[edge++];
+        if (order[next_state_id] == -1) {
+          visit(next_state_id);
+        } else if (on_stack[next_state_id]) {
+          lowlink[state_id] = std::min(lowlink[state_id], order[next_state_id]);
+        }
+        continue;
+      }
+
+      search.pop_back();
+      if (!search.empty()) {
+        StateID parent_id = search.back().first;
+        lowlink[parent_id] = std::min(lowlink[parent_id], lowlink[state_id]);
+      }
+
+      if (lowlink[state_id] != order[state_id]) {
+        continue;
+      }
+
+      // state_id is the root of a finished component; pop its members
+      StateID component_id = static_cast<StateID>(component_closures_.size());
+      StateIDs closure;
+      StateID member_id;
+      do {
+        member_id = component_stack.back();
+        component_stack.pop_back();
+        on_stack[member_id] = false;
+        component_[member_id] = component_id;
+        in_closure[member_id] = true;
+        closure.push_back(member_id);
+      } while (member_id != state_id);
+
+      for (Index i = 0, members = closure.size(); i < members; i++) {
+        StateID member = closure[i];
+        for (Index e = epsilon_begin[member]; e < epsilon_begin[member + 1];
+             e++) {
+          StateID successor = component_[epsilon_targets[e]];
+          if (successor == component_id) {
+            continue;
+          }
+          for (StateID reachable_id : component_closures_[successor]) {
+            if (!in_closure[reachable_id]) {
+              in_closure[reachable_id] = true;
+              closure.push_back(reachable_id);
+            }
+          }
+        }
+      }
+
+      for (StateID reachable_id : closure) {
+        in_closure[reachable_id] = false;
+      }
+      std::sort(closure.begin(), closure.end());
+      component_closures_.push_back(std::move(closure));
+    }
+  }
+}
+
+// Builds the union as a bitset so that reading it back word by word yields
+// the IDs already sorted. A state already in the union is skipped, because
+// its closure is then part of the union too. The bitset is cleared again on
+// the way out, so a single scratch bitset serves every call.
+StateSet EpsilonClosures::closureOf(const StateIDs &states) const {
+  Size count = 0;
+  Index first_word = in_closure_.size();
+  Index last_word = 0;
+
+  for (StateID state_id : states) {
+    if (in_closure_[state_id / 64] >> (state_id % 64) & 1) {
+      continue;
+    }
+    const StateIDs &closure = get(state_id);
+    for (StateID reachable_id : closure) {
+      uint64_t bit = uint64_t{1} << (reachable_id % 64);
+      uint64_t &word = in_closure_[reachable_id / 64];
+      count += !(word & bit);
+      word |= bit;
+    }
+    first_word = std::min<Index>(first_word, closure.front() / 64);
+    last_word = std::max<Index>(last_word, closure.back() / 64);
+  }
+
+  StateIDs result;
+  result.reserve(count);
+  for (Index w = first_word; w <= last_word && w < in_closure_.size(); w++) {
+    for (uint64_t word = in_closure_[w]; word != 0; word &= word - 1) {
+      result.push_back(static_cast<StateID>(w * 64 + std::countr_zero(word)));
+    }
+    in_closure_[w] = 0;
+  }
+
+  return StateSet(std::move(result));
+}
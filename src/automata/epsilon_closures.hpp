@@ -0,0 +1,28 @@
+#pragma once
+
+#include "../common/types.hpp"
+#include "nfa.hpp"
+#include "state_set.hpp"
+#include <cstdint>
+
+// The epsilon closure of every state of an NFA, computed once up front.
+// Every state of a strongly connected component of the epsilon graph has the
+// same closure, so it is stored once per component in sorted order.
+class EpsilonClosures {
+private:
+  StateIDs component_;
+  Vector<StateIDs> component_closures_;
+  // Scratch bitset of closureOf, all zero between calls
+  mutable Vector<uint64_t> in_closure_;
+
+public:
+  explicit EpsilonClosures(const NFA &);
+
+  // The closure of one state, sorted
+  const StateIDs &get(StateID state_id) const {
+    return component_closures_[component_[state_id]];
+  }
+
+  // The union of the closures of states, which may repeat
+  StateSet closureOf(const StateIDs &states) const;
+};
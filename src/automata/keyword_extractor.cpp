@@ -0,0 +1,82 @@
+#include "keyword_extractor.hpp"
+
+String KeywordExtractor::literalOf(const RegexASTNode *node) {
+  if (auto char_node = dynamic_cast<const CharNode *>(node)) {
+    return String(1, char_node->value_);
+  }
+
+  if (auto concat_node = dynamic_cast<const ConcatNode *>(node)) {
+    String left = literalOf(concat_node->left_.get());
+    String right = literalOf(concat_node->right_.get());
+    if (left.empty() || right.empty()) {
+      return String{};
+    }
+    return left + right;
+  }
+
+  return String{};
+}
+
+Vector<Keyword> KeywordExtractor::extract(const Vector<String> &token_types,
+                                          const Vector<NFA> &nfas,
+                                          const Vector<String> &literals) {
+  Vector<Keyword> keywords;
+  Vector<EpsilonClosures> closures;
+  for (const NFA &nfa : nfas) {
+    closures.emplace_back(nfa);
+  }
+
+  for (Index k = 0; k < token_types.size(); k++) {
+    const String &literal = literals[k];
+    if (literal.empty()) {
+      continue;
+    }
+
+    // A higher-priority rule that matches the literal already shadows it
+    bool shadowed = false;
+    for (Index j = 0; j < k && !shadowed; j++) {
+      shadowed = accepts(nfas[j], closures[j], literal);
+    }
+    if (shadowed) {
+      continue;
+    }
+
+    // The rule that takes over the literal must stay in the DFA
+    for (Index j = k + 1; j < token_types.size(); j++) {
+      if (!accepts(nfas[j], closures[j], literal)) {
+        continue;
+      }
+      if (literals[j].empty()) {
+        keywords.push_back({literal, token_types[k], token_types[j]});
+      }
+      break;
+    }
+  }
+
+  return keywords;
+}
+
+// Runs the NFA over the whole string
+bool KeywordExtractor::accepts(const NFA &nfa, const EpsilonClosures &closures,
+                               const String &input) {
+  StateSet current = closures.closureOf({nfa.getStartStateID()});
+
+  for (Symbol symbol : input) {
+    StateIDs next;
+    for (StateID state_id : current.getIDs()) {
+      const StateIDs next_states = nfa.getNextStateIDs(state_id, symbol);
+      next.insert(next.end(), next_states.begin(), next_states.end());
+    }
+    current = closures.closureOf(next);
+    if (current.empty()) {
+      return false;
+    }
+  }
+
+  for (StateID state_id : current.getIDs()) {
+    if (nfa.isAccepting(state_id)) {
+      return true;
+    }
+  }
+  return false;
+}
@@ -0,0 +1,34 @@
+#pragma once
+
+#include "../common/types.hpp"
+#include "../regex/regex_ast.hpp"
+#include "epsilon_closures.hpp"
+#include "nfa.hpp"
+
+// A pure-literal rule that the generated scanner recognizes by looking up the
+// lexeme of a lower-priority rule, instead of through DFA states of its own
+struct Keyword {
+  String lexeme;
+  String token_type;
+  // The rule the DFA reports for lexeme once the keyword rule is dropped
+  String base_token_type;
+};
+
+class KeywordExtractor {
+public:
+  // Returns the string matched by a regex made only of characters, or an
+  // empty string for any other regex
+  static String literalOf(const RegexASTNode *);
+
+  // Rules are given in priority order, literals[i] being literalOf the regex
+  // of rule i. A literal rule becomes a keyword when no higher-priority rule
+  // matches its literal and the highest-priority rule below it that does is
+  // not a literal itself. Dropping such a rule leaves the language of the
+  // spec unchanged, and the lookup restores its token type.
+  static Vector<Keyword> extract(const Vector<String> &token_types,
+                                 const Vector<NFA> &nfas,
+                                 const Vector<String> &literals);
+
+private:
+  static bool accepts(const NFA &, const EpsilonClosures &, const String &);
+};
@@ -1,4 +1,5 @@
 #include "nfa.hpp"
+#include <climits>
 
 void NFA::addTransition(StateID from, Symbol symbol, StateID to) {
   transitions_[from][symbol].push_back(to);
@@ -43,3 +44,36 @@ Symbols NFA::getSymbols(StateID from) const {
   }
   return symbols;
 }
+
+// Picks the highest-priority (lowest declaration index) token type, which
+// implements the "first declaration wins" rule: e.g. RETURN beats IDENTIFIER
+// when both match, because RETURN was declared earlier by the user. The
+// determinizer and the NFA optimizer both resolve through here, so they
+// always agree on which token wins.
+String
+NFA::resolveTokenType(const StateIDs &state_ids,
+                      const UnorderedMap<String, int> &token_priority) const {
+  String best_token;
+  int best_priority = INT_MAX;
+
+  for (StateID id : state_ids) {
+    if (!isAccepting(id))
+      continue;
+
+    String token_type = getTokenType(id);
+    if (token_type.empty())
+      continue;
+
+    auto it = token_priority.find(token_type);
+    // If not found in priority map, treat as lowest priority (INT_MAX - 1)
+    // so it can still win over an empty token type.
+    int priority = (it != token_priority.end()) ? it->second : (INT_MAX - 1);
+
+    if (priority < best_priority) {
+      best_priority = priority;
+      best_token = token_type;
+    }
+  }
+
+  return best_token;
+}
@@ -22,4 +22,10 @@ public:
   StateIDs getNextStateIDs(StateID, Symbol) const;
   StateIDs getEpsilonNextStatesIDs(StateID) const;
   Symbols getSymbols(StateID) const;
+
+  // token_priority maps each token type to its declaration index. Returns
+  // the token type with the lowest index among the accepting states in
+  // state_ids, or an empty string when none of them accepts.
+  String resolveTokenType(const StateIDs &state_ids,
+                          const UnorderedMap<String, int> &token_priority) const;
 };
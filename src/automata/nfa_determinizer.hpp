@@ -2,7 +2,9 @@
 
 #include "../common/types.hpp"
 #include "dfa.hpp"
+#include "epsilon_closures.hpp"
 #include "nfa.hpp"
+#include "state_set.hpp"
 
 class NFADeterminizer {
 public:
@@ -14,15 +16,17 @@ public:
                          const UnorderedMap<String, int> &token_priority);
 
 private:
-  static Closure epsilonClosure(const NFA &, StateID);
-  static Closure epsilonClosure(const NFA &, const Superstate &);
-  static Superstate move(const NFA &, const Superstate &, Symbol);
-  static bool containsAcceptingState(const NFA &, const Superstate &);
+  // The NFA's transitions copied into flat arrays indexed by state, so that
+  // the subset construction reads them without a map lookup or a copy
+  struct FlatNFA {
+    // Edges of state s are edges[edges_begin[s] .. edges_begin[s + 1]), as
+    // (symbol class, target) pairs
+    Vector<Index> edges_begin;
+    Vector<Pair<int, StateID>> edges;
+  };
 
-  // Returns the token type with the lowest priority index among all accepting
-  // NFA states in the superstate. Falls back to the first accepting state found
-  // if a token type is not present in token_priority.
-  static String
-  resolveTokenType(const NFA &, const Superstate &,
-                   const UnorderedMap<String, int> &token_priority);
+  static FlatNFA flatten(const NFA &, const SymbolClasses &);
+  static void move(const FlatNFA &, const StateSet &,
+                   Vector<StateIDs> &targets_by_class);
+  static bool containsAcceptingState(const NFA &, const StateSet &);
 };
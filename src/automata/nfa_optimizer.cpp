@@ -0,0 +1,247 @@
+#include "nfa_optimizer.hpp"
+#include "epsilon_closures.hpp"
+#include <algorithm>
+
+NFA NFAOptimizer::optimize(const NFA &nfa,
+                           const UnorderedMap<String, int> &token_priority) {
+  return mergeEquivalent(prune(eliminateEpsilons(nfa, token_priority)));
+}
+
+NFASize NFAOptimizer::measure(const NFA &nfa) {
+  NFASize size;
+  size.states = nfa.getStates().size();
+
+  for (StateID id = 0; id < static_cast<StateID>(size.states); id++) {
+    size.transitions += edgesOf(nfa, id).size();
+    size.epsilon_transitions += nfa.getEpsilonNextStatesIDs(id).size();
+  }
+
+  return size;
+}
+
+// Only the start state and the targets of symbol transitions are ever entered
+// other than through an epsilon move, so only they are kept. Each takes over
+// the symbol transitions and the acceptance of the states in its epsilon
+// closure.
+NFA NFAOptimizer::eliminateEpsilons(
+    const NFA &nfa, const UnorderedMap<String, int> &token_priority) {
+  Size state_count = nfa.getStates().size();
+  StateID start_state = nfa.getStartStateID();
+
+  Vector<Edges> edges(state_count);
+  Vector<bool> is_kept(state_count, false);
+  is_kept[start_state] = true;
+  for (StateID id = 0; id < static_cast<StateID>(state_count); id++) {
+    edges[id] = edgesOf(nfa, id);
+    for (const auto &[symbol, target] : edges[id]) {
+      is_kept[target] = true;
+    }
+  }
+
+  StateIDs kept;
+  StateIDs new_ids(state_count, -1);
+  for (StateID id = 0; id < static_cast<StateID>(state_count); id++) {
+    if (is_kept[id]) {
+      new_ids[id] = kept.size();
+      kept.push_back(id);
+    }
+  }
+
+  States states;
+  for (Index i = 0; i < kept.size(); i++) {
+    states.push_back(State{static_cast<StateID>(i)});
+  }
+  NFA result(nfa.getAlphabet(), states, UnorderedMap<StateID, String>{},
+             new_ids[start_state]);
+  result.resizeTransitions(kept.size());
+
+  EpsilonClosures closures(nfa);
+  for (Index i = 0; i < kept.size(); i++) {
+    const StateIDs &closure = closures.get(kept[i]);
+
+    Edges merged;
+    bool accepting = false;
+    for (StateID id : closure) {
+      accepting = accepting || nfa.isAccepting(id);
+      for (const auto &[symbol, target] : edges[id]) {
+        merged.push_back({symbol, new_ids[target]});
+      }
+    }
+
+    std::sort(merged.begin(), merged.end());
+    merged.erase(std::unique(merged.begin(), merged.end()), merged.end());
+    for (const auto &[symbol, target] : merged) {
+      result.addTransition(i, symbol, target);
+    }
+
+    if (accepting) {
+      result.getAcceptingStateIDsToTokenTypes()[i] =
+          nfa.resolveTokenType(closure, token_priority);
+    }
+  }
+
+  return result;
+}
+
+// Keeps the states that are reachable from the start state and can reach an
+// accepting state; the start state stays even when nothing is accepted
+NFA NFAOptimizer::prune(const NFA &nfa) {
+  Size state_count = nfa.getStates().size();
+  StateID start_state = nfa.getStartStateID();
+
+  Vector<Edges> edges(state_count);
+  Vector<StateIDs> predecessors(state_count);
+  for (StateID id = 0; id < static_cast<StateID>(state_count); id++) {
+    edges[id] = edgesOf(nfa, id);
+    for (const auto &[symbol, target] : edges[id]) {
+      predecessors[target].push_back(id);
+    }
+  }
+
+  Vector<bool> reachable(state_count, false);
+  StateIDs worklist{start_state};
+  reachable[start_state] = true;
+  while (!worklist.empty()) {
+    StateID id = worklist.back();
+    worklist.pop_back();
+    for (const auto &[symbol, target] : edges[id]) {
+      if (!reachable[target]) {
+        reachable[target] = true;
+        worklist.push_back(target);
+      }
+    }
+  }
+
+  Vector<bool> live(state_count, false);
+  for (StateID id : nfa.getAcceptingStateIDs()) {
+    live[id] = true;
+    worklist.push_back(id);
+  }
+  while (!worklist.empty()) {
+    StateID id = worklist.back();
+    worklist.pop_back();
+    for (StateID predecessor : predecessors[id]) {
+      if (!live[predecessor]) {
+        live[predecessor] = true;
+        worklist.push_back(predecessor);
+      }
+    }
+  }
+
+  StateIDs kept;
+  StateIDs new_ids(state_count, -1);
+  for (StateID id = 0; id < static_cast<StateID>(state_count); id++) {
+    if (reachable[id] && (live[id] || id == start_state)) {
+      new_ids[id] = kept.size();
+      kept.push_back(id);
+    }
+  }
+
+  return rebuild(nfa, kept, new_ids);
+}
+
+// Merges states that accept the same token type and have the same
+// transitions, which makes them accept the same strings. Merging can make the
+// transitions of their predecessors identical in turn, so the pass repeats
+// until nothing changes; shared suffixes such as those of keywords collapse
+// one level per round.
+NFA NFAOptimizer::mergeEquivalent(const NFA &nfa) {
+  Size state_count = nfa.getStates().size();
+
+  Vector<Edges> edges(state_count);
+  StateIDs representative(state_count);
+  for (StateID id = 0; id < static_cast<StateID>(state_count); id++) {
+    edges[id] = edgesOf(nfa, id);
+    representative[id] = id;
+  }
+
+  bool merged = true;
+  while (merged) {
+    merged = false;
+    Map<Pair<String, Edges>, StateID> first_with_signature;
+
+    for (StateID id = 0; id < static_cast<StateID>(state_count); id++) {
+      if (representative[id] != id) {
+        continue;
+      }
+
+      Edges signature;
+      for (const auto &[symbol, target] : edges[id]) {
+        signature.push_back({symbol, representative[target]});
+      }
+      std::sort(signature.begin(), signature.end());
+      signature.erase(std::unique(signature.begin(), signature.end()),
+                      signature.end());
+
+      // Non-accepting states get a key no token type can produce
+      String token = nfa.isAccepting(id) ? nfa.getTokenType(id) : String();
+      token.insert(token.begin(), nfa.isAccepting(id) ? '+' : '-');
+      auto [it, inserted] =
+          first_with_signature.insert({{token, std::move(signature)}, id});
+      if (!inserted) {
+        representative[id] = it->second;
+        merged = true;
+      }
+    }
+
+    for (StateID id = 0; id < static_cast<StateID>(state_count); id++) {
+      representative[id] = representative[representative[id]];
+    }
+  }
+
+  StateIDs kept;
+  StateIDs new_ids(state_count, -1);
+  for (StateID id = 0; id < static_cast<StateID>(state_count); id++) {
+    if (representative[id] == id) {
+      new_ids[id] = kept.size();
+      kept.push_back(id);
+    }
+  }
+  for (StateID id = 0; id < static_cast<StateID>(state_count); id++) {
+    new_ids[id] = new_ids[representative[id]];
+  }
+
+  return rebuild(nfa, kept, new_ids);
+}
+
+NFA NFAOptimizer::rebuild(const NFA &nfa, const StateIDs &kept,
+                          const StateIDs &new_ids) {
+  States states;
+  for (Index i = 0; i < kept.size(); i++) {
+    states.push_back(State{static_cast<StateID>(i)});
+  }
+  NFA result(nfa.getAlphabet(), states, UnorderedMap<StateID, String>{},
+             new_ids[nfa.getStartStateID()]);
+  result.resizeTransitions(kept.size());
+
+  for (Index i = 0; i < kept.size(); i++) {
+    Edges mapped;
+    for (const auto &[symbol, target] : edgesOf(nfa, kept[i])) {
+      if (new_ids[target] != -1) {
+        mapped.push_back({symbol, new_ids[target]});
+      }
+    }
+    std::sort(mapped.begin(), mapped.end());
+    mapped.erase(std::unique(mapped.begin(), mapped.end()), mapped.end());
+    for (const auto &[symbol, target] : mapped) {
+      result.addTransition(i, symbol, target);
+    }
+
+    if (nfa.isAccepting(kept[i])) {
+      result.getAcceptingStateIDsToTokenTypes()[i] = nfa.getTokenType(kept[i]);
+    }
+  }
+
+  return result;
+}
+
+NFAOptimizer::Edges NFAOptimizer::edgesOf(const NFA &nfa, StateID id) {
+  Edges edges;
+  for (Symbol symbol : nfa.getSymbols(id)) {
+    for (StateID target : nfa.getNextStateIDs(id, symbol)) {
+      edges.push_back({symbol, target});
+    }
+  }
+  std::sort(edges.begin(), edges.end());
+  return edges;
+}
@@ -0,0 +1,42 @@
+#pragma once
+
+#include "../common/types.hpp"
+#include "nfa.hpp"
+
+// Counts reported before and after NFAOptimizer::optimize
+struct NFASize {
+  Size states = 0;
+  Size transitions = 0;
+  Size epsilon_transitions = 0;
+};
+
+// Shrinks the merged NFA before subset construction. Every state of the
+// result is one that a symbol transition can enter, plus the start state, so
+// superstates only ever hold states that consume input; a state is dropped
+// when it is unreachable or cannot reach an accepting state, and states with
+// the same token type and the same transitions are merged into one.
+class NFAOptimizer {
+public:
+  // token_priority is the determinizer's: when the epsilon closure of a state
+  // holds accepting states for several token types, the lowest index wins.
+  static NFA optimize(const NFA &,
+                      const UnorderedMap<String, int> &token_priority);
+
+  static NFASize measure(const NFA &);
+
+private:
+  // A state's symbol transitions as (symbol, target) pairs, sorted
+  using Edges = Vector<Pair<Symbol, StateID>>;
+
+  static NFA eliminateEpsilons(const NFA &,
+                               const UnorderedMap<String, int> &token_priority);
+  static NFA prune(const NFA &);
+  static NFA mergeEquivalent(const NFA &);
+
+  // Builds the NFA made of the given states of nfa, in order, with targets
+  // mapped through new_ids; a target mapped to -1 is dropped
+  static NFA rebuild(const NFA &, const StateIDs &kept,
+                     const StateIDs &new_ids);
+
+  static Edges edgesOf(const NFA &, StateID);
+};
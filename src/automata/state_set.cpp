@@ -0,0 +1,47 @@
+#include "state_set.hpp"
+
+StateSet::StateSet(StateIDs ids) : ids_(std::move(ids)), hash_(ids_.size()) {
+  for (StateID id : ids_) {
+    hash_ ^= static_cast<Size>(id) + 0x9e3779b97f4a7c15ULL + (hash_ << 6) +
+             (hash_ >> 2);
+  }
+}
+
+// Linear probing from the slot picked by the high bits of the mixed hash,
+// stopping at the set's own slot or at the first empty one
+Index StateSetTable::findSlot(const StateSet &set) const {
+  Size mask = slots_.size() - 1;
+  Index slot = (set.getHash() * 0x9e3779b97f4a7c15ULL >> 32) & mask;
+
+  while (slots_[slot] != -1 && !(sets_[slots_[slot]] == set)) {
+    slot = (slot + 1) & mask;
+  }
+
+  return slot;
+}
+
+void StateSetTable::grow() {
+  slots_.assign(slots_.size() * 2, -1);
+
+  for (Index id = 0; id < sets_.size(); id++) {
+    slots_[findSlot(sets_[id])] = static_cast<StateID>(id);
+  }
+}
+
+Pair<StateID, bool> StateSetTable::intern(StateSet &&set) {
+  Index slot = findSlot(set);
+  if (slots_[slot] != -1) {
+    return {slots_[slot], false};
+  }
+
+  StateID id = static_cast<StateID>(sets_.size());
+  sets_.push_back(std::move(set));
+  slots_[slot] = id;
+
+  // Keep the load factor under one half so probe sequences stay short
+  if (sets_.size() * 2 > slots_.size()) {
+    grow();
+  }
+
+  return {id, true};
+}
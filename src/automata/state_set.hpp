@@ -0,0 +1,49 @@
+#pragma once
+
+#include "../common/types.hpp"
+
+// A set of NFA state IDs kept as a sorted vector, with its hash computed once
+// on construction. Superstates are compared and hashed many times while they
+// are interned, and a flat vector makes both a single pass over contiguous
+// memory instead of a walk over tree nodes.
+class StateSet {
+private:
+  StateIDs ids_;
+  Size hash_;
+
+public:
+  StateSet() : hash_(0) {}
+  // ids must be sorted and free of duplicates
+  explicit StateSet(StateIDs ids);
+
+  const StateIDs &getIDs() const { return ids_; }
+  Size getHash() const { return hash_; }
+  bool empty() const { return ids_.empty(); }
+
+  bool operator==(const StateSet &other) const {
+    return hash_ == other.hash_ && ids_ == other.ids_;
+  }
+};
+
+// Numbers distinct StateSets in the order they are first added. The sets live
+// in one vector indexed by their number, and an open-addressing table of
+// numbers finds them by hash, so a lookup costs one probe sequence over a
+// flat array and, almost always, a single set comparison.
+class StateSetTable {
+private:
+  Vector<StateSet> sets_;
+  // Power-of-two sized; -1 marks an empty slot
+  StateIDs slots_;
+
+  Index findSlot(const StateSet &) const;
+  void grow();
+
+public:
+  StateSetTable() : slots_(64, -1) {}
+
+  // Returns the number of set and whether it was added by this call
+  Pair<StateID, bool> intern(StateSet &&set);
+
+  const StateSet &get(StateID id) const { return sets_[id]; }
+  Size size() const { return sets_.size(); }
+};
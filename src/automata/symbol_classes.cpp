@@ -0,0 +1,57 @@
+#include "symbol_classes.hpp"
+#include "nfa.hpp"
+#include <algorithm>
+#include <climits>
+
+SymbolClasses::SymbolClasses() : class_of_(256) {
+  // Number the classes in the order an Alphabet iterates its symbols
+  for (int c = CHAR_MIN; c <= CHAR_MAX; c++) {
+    class_of_[static_cast<unsigned char>(c)] =
+        static_cast<int>(representatives_.size());
+    representatives_.push_back(static_cast<Symbol>(c));
+  }
+}
+
+// Every (state, target) pair of the NFA is one edge, whatever number of
+// symbols it is taken on. Two symbols belong together exactly when they
+// label the same edges, so each symbol's sorted list of edges is the key of
+// its class.
+SymbolClasses SymbolClasses::compute(const NFA &nfa) {
+  Vector<Vector<int>> edges_of_symbol(256);
+  int edge_count = 0;
+
+  for (const State &state : nfa.getStates()) {
+    UnorderedMap<StateID, int> edge_to_target;
+
+    for (Symbol symbol : nfa.getSymbols(state.getID())) {
+      for (StateID target : nfa.getNextStateIDs(state.getID(), symbol)) {
+        auto [it, inserted] = edge_to_target.insert({target, edge_count});
+        if (inserted) {
+          edge_count++;
+        }
+        edges_of_symbol[static_cast<unsigned char>(symbol)].push_back(
+            it->second);
+      }
+    }
+  }
+
+  SymbolClasses classes;
+  classes.class_of_.assign(256, -1);
+  classes.representatives_.clear();
+
+  Map<Vector<int>, int> edges_to_class;
+  for (Symbol symbol : nfa.getAlphabet()) {
+    Vector<int> &edges = edges_of_symbol[static_cast<unsigned char>(symbol)];
+    std::sort(edges.begin(), edges.end());
+    edges.erase(std::unique(edges.begin(), edges.end()), edges.end());
+
+    auto [it, inserted] = edges_to_class.insert(
+        {std::move(edges), static_cast<int>(classes.representatives_.size())});
+    if (inserted) {
+      classes.representatives_.push_back(symbol);
+    }
+    classes.class_of_[static_cast<unsigned char>(symbol)] = it->second;
+  }
+
+  return classes;
+}
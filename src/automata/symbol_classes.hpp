@@ -0,0 +1,38 @@
+#pragma once
+
+#include "../common/types.hpp"
+
+class NFA;
+
+// A partition of the alphabet into classes that every transition treats
+// alike: from any state, two symbols of one class lead to the same states. An
+// automaton only needs transitions on one symbol per class, its
+// representative, which is the first member of the class in alphabet order.
+class SymbolClasses {
+private:
+  // Indexed by unsigned byte value; -1 for symbols outside the alphabet
+  Vector<int> class_of_;
+  Symbols representatives_;
+
+public:
+  // Puts each of the 256 byte values in a class of its own
+  SymbolClasses();
+
+  // Returns the coarsest partition of the NFA's alphabet that all of its
+  // symbol transitions respect
+  static SymbolClasses compute(const NFA &);
+
+  Size size() const { return representatives_.size(); }
+  const Symbols &getRepresentatives() const { return representatives_; }
+
+  int getClass(Symbol symbol) const {
+    return class_of_[static_cast<unsigned char>(symbol)];
+  }
+
+  // Returns the representative of the class of symbol, or symbol itself when
+  // it is outside the alphabet
+  Symbol getRepresentative(Symbol symbol) const {
+    int symbol_class = getClass(symbol);
+    return symbol_class == -1 ? symbol : representatives_[symbol_class];
+  }
+};
@@ -1,10 +1,17 @@
 #include "code_generator.hpp"
+#include "../automata/backtrack_analyzer.hpp"
+#include "../automata/dfa_renumberer.hpp"
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
 #include <fstream>
 #include <iostream>
 
-void CodeGenerator::generateScanner(const DFA &dfa,
+void CodeGenerator::generateScanner(const DFA &minimized,
                                     const Vector<String> &token_types,
-                                    const String &output_filename) {
+                                    const String &output_filename,
+                                    const GeneratorOptions &options,
+                                    const Vector<Keyword> &keywords) {
   std::ofstream out(output_filename);
 
   if (!out.is_open()) {
@@ -19,42 +26,341 @@ void CodeGenerator::generateScanner(const DFA &dfa,
     token_type_to_index[token_types[i]] = static_cast<int>(i);
   }
 
+  // Number the accepting states last, so that the scanner can test for them
+  // with a single comparison against FIRST_ACCEPTING_STATE
+  DFA dfa = DFARenumberer::renumber(minimized);
+
+  // Group bytes that behave identically in every state
+  Vector<int> char_classes = computeCharClasses(dfa);
+
+  // The shuffle backend keeps every state in one vector lane, so it only
+  // fits small DFAs
+  GeneratorOptions scanner_options = options;
+  int sheng_width = shengWidth(dfa);
+  if (options.backend == Backend::SHENG && sheng_width == 0) {
+    std::cerr << "Warning: The sheng backend supports at most 63 states, but "
+                 "the DFA has "
+              << dfa.getStates().size()
+              << "; falling back to the table backend" << std::endl;
+    scanner_options.backend = Backend::TABLE;
+  }
+
+  // The pair table grows with the square of the class count, so it is only
+  // built while it stays near cache size
+  const Size max_pair_cells = 1 << 20;
+  Size num_classes =
+      *std::max_element(char_classes.begin(), char_classes.end()) + 1;
+  Size pair_cells = dfa.getStates().size() * num_classes * num_classes;
+  if (options.backend == Backend::STRIDE2) {
+    if (pair_cells > max_pair_cells) {
+      std::cerr << "Warning: The stride2 table would have " << pair_cells
+                << " cells; falling back to the table backend" << std::endl;
+      scanner_options.backend = Backend::TABLE;
+    } else if (options.sentinel) {
+      // A pair lookup at the sentinel would read one byte past it
+      std::cerr << "Warning: The stride2 backend checks the input length "
+                   "once per pair; sentinel mode is disabled"
+                << std::endl;
+      scanner_options.sentinel = false;
+    }
+  }
+
+  // The failure memo is kept by the table matcher only
+  if (options.linear && scanner_options.backend != Backend::TABLE) {
+    std::cerr << "Warning: Linear-time mode needs the table backend; using it "
+                 "instead"
+              << std::endl;
+    scanner_options.backend = Backend::TABLE;
+  }
+
+  // The sentinel only stops the walk if no state can consume a zero byte
+  if (options.sentinel) {
+    for (const State &state : dfa.getStates()) {
+      if (dfa.getNextState(state.getID(), '\0') != -1) {
+        std::cerr << "Warning: State " << state.getID()
+                  << " has a transition on the zero byte; sentinel mode is "
+                     "disabled"
+                  << std::endl;
+        scanner_options.sentinel = false;
+        break;
+      }
+    }
+  }
+
+  // The last accepting state only needs tracking when a failed walk can have
+  // passed one. An accepting start state would make the empty match look
+  // like a token, so it also keeps the tracking.
+  BacktrackReport backtrack_report = BacktrackAnalyzer::analyze(dfa);
+  MatchLoopOptions loop{scanner_options.sentinel,
+                        backtrack_report.isBacktrackFree() &&
+                            !dfa.isAccepting(dfa.getStartStateID()) &&
+                            !scanner_options.linear,
+                        scanner_options.linear, !keywords.empty()};
+  reportBacktracking(backtrack_report);
+
   // Write header
+  out << "#include <algorithm>\n";
+  out << "#include <cerrno>\n";
+  out << "#include <cstdint>\n";
+  out << "#include <cstdlib>\n";
+  out << "#include <cstring>\n";
+  out << "#include <deque>\n";
+  out << "#include <exception>\n";
+  out << "#include <functional>\n";
+  out << "#include <memory>\n";
+  out << "#include <stdexcept>\n";
   out << "#include <string>\n";
-  out << "#include <cstring>\n\n";
+  out << "#include <string_view>\n";
+  out << "#include <vector>\n";
+  out << "// The file entry points need POSIX; define LEXY_NO_POSIX to leave "
+         "them out\n";
+  out << "#if !defined(LEXY_NO_POSIX) && (defined(__unix__) || "
+         "defined(__APPLE__))\n";
+  out << "#define LEXY_POSIX 1\n";
+  out << "#include <fcntl.h>\n";
+  out << "#include <sys/mman.h>\n";
+  out << "#include <sys/stat.h>\n";
+  out << "#include <unistd.h>\n";
+  out << "#endif\n";
+  out << "// The threaded entry points need std::thread, and so -pthread on "
+         "some\n";
+  out << "// toolchains; define LEXY_NO_THREADS to leave them out\n";
+  out << "#ifndef LEXY_NO_THREADS\n";
+  out << "#define LEXY_THREADS 1\n";
+  out << "#include <condition_variable>\n";
+  out << "#include <mutex>\n";
+  out << "#include <thread>\n";
+  out << "#endif\n";
+  out << "#if defined(__SSE2__)\n";
+  out << "#include <immintrin.h>\n";
+  out << "#endif\n";
+  out << "#ifdef LEXY_SCAN_MAIN\n";
+  out << "#include <cstdio>\n";
+  out << "#include <filesystem>\n";
+  out << "#endif\n\n";
+
+  out << "// Thread safety: the tables below are static const and never "
+         "written, so any\n";
+  out << "// number of threads may scan with them at once. A Scanner or "
+         "StreamScanner\n";
+  out << "// must only be used by one thread at a time; scanFiles and "
+         "parallelTokenize\n";
+  out << "// give each thread its own.\n\n";
+
+  // Write the narrowest cell types that hold every state and token index
+  out << generateCellTypes(dfa, token_types);
 
-  // Write transition table
-  out << generateTransitionTable(dfa);
+  // Write byte-to-class map and the class-indexed transition table
+  out << generateCharClassTable(char_classes);
+  out << generateTransitionTable(dfa, char_classes);
 
   // Write accepting states (now with correct token indices)
   out << generateAcceptingStates(dfa, token_type_to_index);
 
+  // Write the literal chains that the table matcher compares at once
+  if (scanner_options.backend == Backend::TABLE && !scanner_options.linear) {
+    Vector<LiteralChain> chains = computeLiteralChains(dfa);
+    if (!chains.empty())
+      out << generateLiteralChains(dfa, chains);
+  }
+
+  // Write one shuffle mask per byte class for the sheng backend
+  if (scanner_options.backend == Backend::SHENG)
+    out << generateShengMasks(dfa, char_classes, sheng_width);
+
+  // Write the two-byte table for the stride2 backend, and how it compares
+  // with the one-byte table
+  if (scanner_options.backend == Backend::STRIDE2) {
+    Size cell_size = cellBytes(dfa.getStates().size());
+    std::cout << "Stride2 table: " << pair_cells << " cells ("
+              << pair_cells * cell_size << " bytes), against "
+              << dfa.getStates().size() * num_classes << " cells ("
+              << dfa.getStates().size() * num_classes * cell_size
+              << " bytes) for one byte per lookup" << std::endl;
+    out << generatePairTable(dfa, char_classes, loop.backtrack_free);
+  }
+
   // Write token names
   out << generateTokenNames(token_types);
 
+  // Write the perfect hash table of keywords dropped from the DFA
+  if (!keywords.empty())
+    out << generateKeywordTable(keywords, token_type_to_index);
+
   // Write scanner class
-  out << generateScannerClass(dfa, token_types);
+  out << generateScannerClass(dfa, token_types, token_type_to_index,
+                              scanner_options, loop);
+
+  // Write the chunked streaming scanner
+  out << generateStreamScanner(loop);
+
+  // Write the command-line driver, compiled in with -DLEXY_SCAN_MAIN
+  out << generateScanMain();
 
   out.close();
   std::cout << "Generated scanner: " << output_filename << std::endl;
 }
 
-String CodeGenerator::generateTransitionTable(const DFA &dfa) {
+// Tells the user whether matchToken can skip the last-accept bookkeeping, or
+// which states force it and how far a failed match can back up
+void CodeGenerator::reportBacktracking(const BacktrackReport &report) {
+  if (report.isBacktrackFree()) {
+    std::cout << "Backtracking: none, no non-accepting state follows an "
+                 "accepting one"
+              << std::endl;
+    return;
+  }
+
+  std::cout << "Backtracking: required by non-accepting states";
+  for (Index i = 0; i < report.offending_states.size(); i++)
+    std::cout << (i == 0 ? " " : ", ") << report.offending_states[i];
+  std::cout << " after accepting ones; a failed match backs up ";
+  if (report.max_distance == -1)
+    std::cout << "an unbounded number of bytes";
+  else
+    std::cout << "at most " << report.max_distance << " bytes";
+  std::cout << std::endl;
+}
+
+// Returns the width in bytes of the smallest unsigned type able to represent
+// max_value
+Size CodeGenerator::cellBytes(Size max_value) {
+  if (max_value <= UINT8_MAX)
+    return 1;
+  if (max_value <= UINT16_MAX)
+    return 2;
+  return 4;
+}
+
+// Returns the smallest unsigned type able to represent max_value
+String CodeGenerator::cellType(Size max_value) {
+  return "uint" + std::to_string(cellBytes(max_value) * 8) + "_t";
+}
+
+// The dead state and the "not accepting" marker take the first value past the
+// real states and tokens, so they cost no extra width in the common case. The
+// accepting states are the live states from FIRST_ACCEPTING_STATE up.
+String CodeGenerator::generateCellTypes(const DFA &dfa,
+                                        const Vector<String> &token_types) {
+  StringStream string_stream;
+  Size num_states = dfa.getStates().size();
+  Size num_tokens = token_types.size();
+
+  string_stream << "typedef " << cellType(num_states) << " state_t;\n";
+  string_stream << "typedef " << cellType(num_tokens) << " token_t;\n\n";
+  string_stream << "static const state_t START_STATE = "
+                << dfa.getStartStateID() << ";\n";
+  string_stream << "static const state_t FIRST_ACCEPTING_STATE = "
+                << DFARenumberer::countNonAccepting(dfa) << ";\n";
+  string_stream << "static const state_t DEAD_STATE = " << num_states
+                << ";\n";
+  string_stream << "static const token_t NO_TOKEN = " << num_tokens
+                << ";\n\n";
+
+  return string_stream.str();
+}
+
+// Two bytes are equivalent when every state sends them to the same target, so
+// they can share a single column of the transition table. Classes are numbered
+// in order of their first byte. Bytes of one of the DFA's symbol classes
+// always share a column, so only the first byte of each symbol class is
+// looked at.
+Vector<int> CodeGenerator::computeCharClasses(const DFA &dfa) {
+  const States states = dfa.getStates();
+  const SymbolClasses &symbol_classes = dfa.getSymbolClasses();
+  Map<Vector<StateID>, int> column_to_class;
+  Map<int, int> symbol_class_to_class;
+  Vector<int> char_classes(256);
+
+  for (int c = 0; c < 256; c++) {
+    int symbol_class = symbol_classes.getClass(static_cast<char>(c));
+    auto known = symbol_class_to_class.find(symbol_class);
+    if (known != symbol_class_to_class.end()) {
+      char_classes[c] = known->second;
+      continue;
+    }
+
+    Vector<StateID> column;
+    column.reserve(states.size());
+    for (const State &state : states) {
+      column.push_back(dfa.getNextState(state.getID(), static_cast<char>(c)));
+    }
+
+    auto it = column_to_class.find(column);
+    if (it == column_to_class.end()) {
+      int new_class = static_cast<int>(column_to_class.size());
+      it = column_to_class.emplace(std::move(column), new_class).first;
+    }
+    char_classes[c] = it->second;
+    symbol_class_to_class[symbol_class] = it->second;
+  }
+
+  return char_classes;
+}
+
+String CodeGenerator::generateCharClassTable(const Vector<int> &char_classes) {
+  StringStream string_stream;
+
+  int num_classes =
+      *std::max_element(char_classes.begin(), char_classes.end()) + 1;
+
+  string_stream << "static const " << cellType(num_classes - 1)
+                << " CHAR_CLASS[256] = {\n";
+
+  for (int c = 0; c < 256; c++) {
+    if (c % 16 == 0)
+      string_stream << "    ";
+    string_stream << char_classes[c];
+    if (c < 255)
+      string_stream << ",";
+    string_stream << (c % 16 == 15 ? "\n" : " ");
+  }
+
+  string_stream << "};\n\n";
+  return string_stream.str();
+}
+
+// Any byte of a class can stand in for the whole class; returns the first
+// byte of each class
+Vector<int>
+CodeGenerator::computeClassRepresentatives(const Vector<int> &char_classes) {
+  int num_classes =
+      *std::max_element(char_classes.begin(), char_classes.end()) + 1;
+
+  Vector<int> representatives(num_classes, -1);
+  for (int c = 0; c < 256; c++) {
+    if (representatives[char_classes[c]] == -1)
+      representatives[char_classes[c]] = c;
+  }
+  return representatives;
+}
+
+String CodeGenerator::generateTransitionTable(const DFA &dfa,
+                                              const Vector<int> &char_classes) {
   StringStream string_stream;
   Size num_states = dfa.getStates().size();
+  int num_classes =
+      *std::max_element(char_classes.begin(), char_classes.end()) + 1;
+
+  Vector<int> representatives = computeClassRepresentatives(char_classes);
 
-  string_stream << "static const int TRANSITION_TABLE[" << num_states
-                << "][128] = {\n";
+  string_stream << "static const state_t TRANSITION_TABLE[" << num_states
+                << "]["
+                << num_classes << "] = {\n";
 
   for (const State &state : dfa.getStates()) {
     StateID from = state.getID();
     string_stream << "    {";
 
-    for (int c = 0; c < 128; c++) {
-      StateID next = dfa.getNextState(from, static_cast<char>(c));
-      string_stream << next;
+    for (int k = 0; k < num_classes; k++) {
+      StateID next =
+          dfa.getNextState(from, static_cast<char>(representatives[k]));
+      if (next == -1)
+        string_stream << num_states;
+      else
+        string_stream << next;
 
-      if (c < 127)
+      if (k < num_classes - 1)
         string_stream << ", ";
     }
 
@@ -73,7 +379,7 @@ String CodeGenerator::generateAcceptingStates(
   StringStream string_stream;
   Size num_states = dfa.getStates().size();
 
-  string_stream << "static const int ACCEPTING_STATES[" << num_states
+  string_stream << "static const token_t ACCEPTING_STATES[" << num_states
                 << "] = {\n";
 
   for (const State &state : dfa.getStates()) {
@@ -85,7 +391,7 @@ String CodeGenerator::generateAcceptingStates(
       int token_index = (it != token_type_to_index.end()) ? it->second : 0;
       string_stream << "    " << token_index;
     } else {
-      string_stream << "    -1";
+      string_stream << "    NO_TOKEN";
     }
 
     if (id < static_cast<int>(num_states) - 1)
@@ -113,82 +419,2346 @@ String CodeGenerator::generateTokenNames(const Vector<String> &token_types) {
   return string_stream.str();
 }
 
-String CodeGenerator::generateScannerClass(const DFA &dfa,
-                                           const Vector<String> &token_types) {
+// Hash-and-displace perfect hashing (Belazzougui et al., "Hash, displace,
+// and compress"): the 64-bit FNV-1a hash of a keyword selects a bucket, and
+// each bucket gets the first displacement that sends all of its keywords to
+// free slots. Buckets are placed largest first. Returns false if some bucket
+// cannot be placed, in which case the caller retries with more slots.
+bool CodeGenerator::buildKeywordHash(const Vector<Keyword> &keywords,
+                                     Size num_buckets, Size num_slots,
+                                     Vector<uint32_t> &displacements,
+                                     Vector<int> &slots) {
+  const uint32_t max_displacement = 1 << 20;
+  Vector<Vector<int>> buckets(num_buckets);
+  for (Index i = 0; i < keywords.size(); i++) {
+    uint64_t hash = keywordHash(keywords[i].lexeme);
+    buckets[hash & (num_buckets - 1)].push_back(static_cast<int>(i));
+  }
+
+  Vector<Index> order(num_buckets);
+  for (Index b = 0; b < num_buckets; b++)
+    order[b] = b;
+  std::stable_sort(order.begin(), order.end(), [&](Index a, Index b) {
+    return buckets[a].size() > buckets[b].size();
+  });
+
+  displacements.assign(num_buckets, 0);
+  slots.assign(num_slots, -1);
+
+  for (Index b : order) {
+    if (buckets[b].empty())
+      break;
+
+    bool placed = false;
+    for (uint32_t d = 0; d < max_displacement && !placed; d++) {
+      Vector<Index> chosen;
+      for (int k : buckets[b]) {
+        Index slot = keywordSlot(keywordHash(keywords[k].lexeme), d, num_slots);
+        if (slots[slot] != -1 ||
+            std::find(chosen.begin(), chosen.end(), slot) != chosen.end())
+          break;
+        chosen.push_back(slot);
+      }
+      if (chosen.size() != buckets[b].size())
+        continue;
+
+      for (Index i = 0; i < chosen.size(); i++)
+        slots[chosen[i]] = buckets[b][i];
+      displacements[b] = d;
+      placed = true;
+    }
+
+    if (!placed)
+      return false;
+  }
+
+  return true;
+}
+
+// 64-bit FNV-1a, computed the same way by the generated resolveKeyword
+uint64_t CodeGenerator::keywordHash(const String &lexeme) {
+  uint64_t hash = 14695981039346656037ULL;
+  for (char c : lexeme)
+    hash = (hash ^ static_cast<unsigned char>(c)) * 1099511628211ULL;
+  return hash;
+}
+
+Index CodeGenerator::keywordSlot(uint64_t hash, uint32_t displacement,
+                                 Size num_slots) {
+  uint64_t displaced = (hash ^ displacement) * 0x9E3779B97F4A7C15ULL;
+  return static_cast<Index>(displaced >> 32) & (num_slots - 1);
+}
+
+String CodeGenerator::generateKeywordTable(
+    const Vector<Keyword> &keywords,
+    const UnorderedMap<String, int> &token_type_to_index) {
+  StringStream string_stream;
+
+  // About four keywords per bucket, and at least one slot per keyword
+  Size num_buckets = 1;
+  while (num_buckets * 4 < keywords.size())
+    num_buckets *= 2;
+  Size num_slots = 1;
+  while (num_slots < keywords.size())
+    num_slots *= 2;
+
+  Vector<uint32_t> displacements;
+  Vector<int> slots;
+  while (!buildKeywordHash(keywords, num_buckets, num_slots, displacements,
+                           slots))
+    num_slots *= 2;
+
+  Size min_length = keywords[0].lexeme.size();
+  Size max_length = min_length;
+  for (const Keyword &keyword : keywords) {
+    min_length = std::min(min_length, keyword.lexeme.size());
+    max_length = std::max(max_length, keyword.lexeme.size());
+  }
+
+  string_stream << "// Keywords left out of the DFA. When the DFA matches a "
+                   "keyword's base rule,\n";
+  string_stream << "// the lexeme's FNV-1a hash picks a bucket, and the "
+                   "bucket's displacement\n";
+  string_stream << "// picks the only slot of KEYWORDS the lexeme can "
+                   "occupy.\n";
+  string_stream << "struct KeywordEntry {\n";
+  string_stream << "    const char* lexeme;\n";
+  string_stream << "    uint32_t length;\n";
+  string_stream << "    int base_type;\n";
+  string_stream << "    int type;\n";
+  string_stream << "};\n\n";
+
+  string_stream << "static const uint32_t KEYWORD_DISPLACEMENTS["
+                << num_buckets << "] = {";
+  for (Index b = 0; b < num_buckets; b++) {
+    if (b % 12 == 0)
+      string_stream << "\n    ";
+    string_stream << displacements[b];
+    if (b < num_buckets - 1)
+      string_stream << (b % 12 == 11 ? "," : ", ");
+  }
+  string_stream << "\n};\n\n";
+
+  string_stream << "static const KeywordEntry KEYWORDS[" << num_slots
+                << "] = {\n";
+  for (Index i = 0; i < num_slots; i++) {
+    if (slots[i] == -1) {
+      string_stream << "    {\"\", 0, -1, -1}";
+    } else {
+      const Keyword &keyword = keywords[slots[i]];
+      string_stream << "    {" << cStringLiteral(keyword.lexeme) << ", "
+                    << keyword.lexeme.size() << ", "
+                    << token_type_to_index.at(keyword.base_token_type) << ", "
+                    << token_type_to_index.at(keyword.token_type) << "}";
+    }
+    if (i < num_slots - 1)
+      string_stream << ",";
+    if (slots[i] != -1)
+      string_stream << " // " << keywords[slots[i]].token_type;
+    string_stream << "\n";
+  }
+  string_stream << "};\n\n";
+
+  string_stream << "// Returns the type of the keyword spelled by lexeme if "
+                   "it is one for a token\n";
+  string_stream << "// of token_type, or token_type otherwise\n";
+  string_stream << "static inline int resolveKeyword(int token_type, const "
+                   "char* lexeme, size_t length) {\n";
+  string_stream << "    if (length < " << min_length << " || length > "
+                << max_length << ") return token_type;\n\n";
+  string_stream << "    uint64_t hash = 14695981039346656037ull;\n";
+  string_stream << "    for (size_t i = 0; i < length; i++)\n";
+  string_stream << "        hash = (hash ^ (unsigned char)lexeme[i]) * "
+                   "1099511628211ull;\n";
+  string_stream << "    uint64_t displaced = hash ^ KEYWORD_DISPLACEMENTS[hash "
+                   "& "
+                << num_buckets - 1 << "];\n";
+  string_stream << "    const KeywordEntry& entry = "
+                   "KEYWORDS[(uint32_t)((displaced * "
+                   "0x9E3779B97F4A7C15ull) >> 32) & "
+                << num_slots - 1 << "];\n\n";
+  string_stream << "    if (entry.base_type == token_type && entry.length == "
+                   "length &&\n";
+  string_stream << "        memcmp(entry.lexeme, lexeme, length) == 0)\n";
+  string_stream << "        return entry.type;\n";
+  string_stream << "    return token_type;\n";
+  string_stream << "}\n\n";
+
+  return string_stream.str();
+}
+
+// Quotes a string for C++ source, escaping quotes, backslashes and
+// unprintable bytes
+String CodeGenerator::cStringLiteral(const String &value) {
+  String literal = "\"";
+  for (char c : value) {
+    unsigned char byte = static_cast<unsigned char>(c);
+    if (c == '"' || c == '\\') {
+      literal += '\\';
+      literal += c;
+    } else if (byte >= 32 && byte <= 126) {
+      literal += c;
+    } else {
+      char octal[8];
+      snprintf(octal, sizeof(octal), "\\%03o", byte);
+      literal += octal;
+    }
+  }
+  return literal + "\"";
+}
+
+String CodeGenerator::matcherName(const MatchLoopOptions &loop) {
+  return loop.keywords ? "matchLongest" : "matchToken";
+}
+
+String CodeGenerator::generateScannerClass(
+    const DFA &dfa, const Vector<String> &token_types,
+    const UnorderedMap<String, int> &token_type_to_index,
+    const GeneratorOptions &options, const MatchLoopOptions &loop) {
   StringStream string_stream;
-  StateID start_state = dfa.getStartStateID();
 
   string_stream << "struct Token {\n";
   string_stream << "    int type;\n";
   string_stream << "    std::string lexeme;\n";
   string_stream << "};\n\n";
 
+  string_stream << "// A token as a slice of the scanned buffer, returned "
+                   "without copying the lexeme.\n";
+  string_stream << "// type uses the same codes as Token::type, so "
+                   "END_OF_INPUT and UNKNOWN_TOKEN\n";
+  string_stream << "// are -1 and -2 reinterpreted as uint32_t.\n";
+  string_stream << "struct TokenView {\n";
+  string_stream << "    uint32_t type;\n";
+  string_stream << "    uint64_t offset;\n";
+  string_stream << "    uint32_t length;\n";
+  string_stream << "};\n\n";
+
+  string_stream << "static const uint32_t END_OF_INPUT = UINT32_MAX;\n";
+  string_stream << "static const uint32_t UNKNOWN_TOKEN = UINT32_MAX - 1;\n\n";
+
+  // Logic to skip whitespace if WHITESPACE token type is defined
+  string_stream << "// Token types that are matched but never returned "
+                   "(WHITESPACE)\n";
+  string_stream << "static inline bool isSkippedToken(int token_type) {\n";
+  string_stream << "    (void)token_type;\n";
+  string_stream << "    return false";
+  for (Index i = 0; i < token_types.size(); i++) {
+    if (token_types[i] == "WHITESPACE")
+      string_stream << " || token_type == " << i;
+  }
+  string_stream << ";\n";
+  string_stream << "}\n\n";
+
+  string_stream << "#ifndef LEXY_BATCH_SIZE\n";
+  string_stream << "#define LEXY_BATCH_SIZE 1024\n";
+  string_stream << "#endif\n\n";
+
+  string_stream << "#ifndef LEXY_INTERLEAVE\n";
+  string_stream << "#define LEXY_INTERLEAVE 4\n";
+  string_stream << "#endif\n\n";
+
+  string_stream << "#ifndef LEXY_PARALLEL_MIN_CHUNK_SIZE\n";
+  string_stream << "#define LEXY_PARALLEL_MIN_CHUNK_SIZE 65536\n";
+  string_stream << "#endif\n\n";
+
+  if (options.linear) {
+    string_stream << "#ifndef LEXY_FAILED_PAGE_SIZE\n";
+    string_stream << "#define LEXY_FAILED_PAGE_SIZE 4096\n";
+    string_stream << "#endif\n\n";
+    string_stream << generateFailureMemo();
+  }
+
+  string_stream << "// Structure-of-arrays token storage filled by "
+                   "Scanner::scanBatch and\n";
+  string_stream << "// Scanner::tokenizeAll. Offsets are 64-bit so inputs "
+                   "over 4 GiB fit.\n";
+  string_stream << "struct TokenBuffer {\n";
+  string_stream << "    std::vector<uint32_t> types;\n";
+  string_stream << "    std::vector<uint64_t> offsets;\n";
+  string_stream << "    std::vector<uint32_t> lengths;\n\n";
+  string_stream << "    size_t size() const { return types.size(); }\n\n";
+  string_stream << "    void resize(size_t count) {\n";
+  string_stream << "        types.resize(count);\n";
+  string_stream << "        offsets.resize(count);\n";
+  string_stream << "        lengths.resize(count);\n";
+  string_stream << "    }\n\n";
+  string_stream << "    void clear() { resize(0); }\n\n";
+  string_stream << "    void reserve(size_t count) {\n";
+  string_stream << "        types.reserve(count);\n";
+  string_stream << "        offsets.reserve(count);\n";
+  string_stream << "        lengths.reserve(count);\n";
+  string_stream << "    }\n\n";
+  string_stream << "    void push(uint32_t type, uint64_t offset, uint32_t "
+                   "length) {\n";
+  string_stream << "        types.push_back(type);\n";
+  string_stream << "        offsets.push_back(offset);\n";
+  string_stream << "        lengths.push_back(length);\n";
+  string_stream << "    }\n";
+  string_stream << "};\n\n";
+
+  string_stream << "#ifdef LEXY_POSIX\n";
+  string_stream << "// A read-only memory mapping of a whole file, unmapped "
+                   "when destroyed. Pages\n";
+  string_stream << "// are prefaulted and read ahead sequentially, since "
+                   "scanning touches each\n";
+  string_stream << "// byte once in order. data() is always followed by a "
+                   "readable zero byte, so\n";
+  string_stream << "// the mapping can be scanned in sentinel mode.\n";
+  string_stream << "class MappedFile {\n";
+  string_stream << "private:\n";
+  string_stream << "    const char* bytes;\n";
+  string_stream << "    size_t length;\n\n";
+  string_stream << "public:\n";
+  string_stream << "    explicit MappedFile(const std::string& path) : "
+                   "bytes(\"\"), length(0) {\n";
+  string_stream << "        int fd = open(path.c_str(), O_RDONLY | "
+                   "O_CLOEXEC);\n";
+  string_stream << "        if (fd < 0)\n";
+  string_stream << "            throw std::runtime_error(\"cannot open \" + "
+                   "path + \": \" + strerror(errno));\n\n";
+  string_stream << "        struct stat info;\n";
+  string_stream << "        if (fstat(fd, &info) != 0) {\n";
+  string_stream << "            int error = errno;\n";
+  string_stream << "            close(fd);\n";
+  string_stream << "            throw std::runtime_error(\"cannot stat \" + "
+                   "path + \": \" + strerror(error));\n";
+  string_stream << "        }\n";
+  string_stream << "        if (info.st_size == 0) {\n";
+  string_stream << "            close(fd);\n";
+  string_stream << "            return;\n";
+  string_stream << "        }\n\n";
+  string_stream << "        int flags = MAP_PRIVATE | MAP_FIXED;\n";
+  string_stream << "#ifdef MAP_POPULATE\n";
+  string_stream << "        flags |= MAP_POPULATE;\n";
+  string_stream << "#endif\n";
+  string_stream << "        // Reserve one byte more than the file and map "
+                   "the file over the\n";
+  string_stream << "        // reservation, so a zero byte always follows the "
+                   "data: either the\n";
+  string_stream << "        // zero-filled tail of the last file page or a "
+                   "fresh anonymous page\n";
+  string_stream << "        size_t file_size = (size_t)info.st_size;\n";
+  string_stream << "        void* reserved = mmap(nullptr, file_size + 1, "
+                   "PROT_READ, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);\n";
+  string_stream << "        void* address = reserved == MAP_FAILED ? "
+                   "MAP_FAILED : mmap(reserved, file_size, PROT_READ, flags, "
+                   "fd, 0);\n";
+  string_stream << "        int error = errno;\n";
+  string_stream << "        close(fd);\n";
+  string_stream << "        if (address == MAP_FAILED) {\n";
+  string_stream << "            if (reserved != MAP_FAILED) munmap(reserved, "
+                   "file_size + 1);\n";
+  string_stream << "            throw std::runtime_error(\"cannot map \" + "
+                   "path + \": \" + strerror(error));\n";
+  string_stream << "        }\n\n";
+  string_stream << "        madvise(address, file_size, MADV_SEQUENTIAL);\n";
+  string_stream << "        bytes = (const char*)address;\n";
+  string_stream << "        length = file_size;\n";
+  string_stream << "    }\n\n";
+  string_stream << "    ~MappedFile() {\n";
+  string_stream << "        if (length > 0) munmap((void*)bytes, length + "
+                   "1);\n";
+  string_stream << "    }\n\n";
+
+  string_stream << "    MappedFile(const MappedFile&) = delete;\n";
+  string_stream << "    MappedFile& operator=(const MappedFile&) = delete;\n\n";
+  string_stream << "    const char* data() const { return bytes; }\n";
+  string_stream << "    size_t size() const { return length; }\n";
+  string_stream << "};\n\n";
+
+  string_stream << "#ifdef LEXY_THREADS\n";
+  string_stream << "// What Scanner::scanFiles found in one file. counts[t] "
+                   "is the number of\n";
+  string_stream << "// tokens of type t and counts[NO_TOKEN] that of unknown "
+                   "bytes; skipped\n";
+  string_stream << "// tokens are not counted.\n";
+  string_stream << "struct FileTokens {\n";
+  string_stream << "    std::string path;\n";
+  string_stream << "    TokenBuffer tokens;\n";
+  string_stream << "    std::vector<uint64_t> counts;\n";
+  string_stream << "    // Why the file could not be scanned, or empty\n";
+  string_stream << "    std::string error;\n";
+  string_stream << "};\n";
+  string_stream << "#endif\n";
+  string_stream << "#endif\n\n";
   string_stream << "class Scanner {\n";
   string_stream << "private:\n";
   string_stream << "    const char* input;\n";
   string_stream << "    size_t position;\n";
-  string_stream << "    size_t length;\n\n";
+  string_stream << "    size_t length;\n";
+  string_stream << "#ifdef LEXY_POSIX\n";
+  string_stream << "    // Keeps the input of a scanner made by fromFile "
+                   "mapped\n";
+  string_stream << "    std::shared_ptr<const MappedFile> mapping;\n";
+  string_stream << "#endif\n\n";
+
+  // The DFA walk is the only part that differs between backends
+  if (options.backend == Backend::DIRECT)
+    string_stream << generateDirectMatcher(dfa, token_type_to_index, loop);
+  else if (options.backend == Backend::SHENG)
+    string_stream << generateShengMatcher(shengWidth(dfa), loop);
+  else if (options.backend == Backend::STRIDE2)
+    string_stream << generateStride2Matcher(
+        static_cast<int>(computeClassRepresentatives(computeCharClasses(dfa))
+                             .size()),
+        loop);
+  else
+    string_stream << generateTableMatcher(dfa, loop);
+
+  if (loop.keywords) {
+    string_stream << "    // The longest match, with the token type of a "
+                     "keyword when its lexeme is one\n";
+    string_stream << "    int matchToken(size_t start_pos, size_t& end_pos) "
+                     "const {\n";
+    string_stream << "        int token_type = matchLongest(start_pos, "
+                     "end_pos);\n";
+    string_stream << "        if (token_type == NO_TOKEN) return NO_TOKEN;\n";
+    string_stream << "        return resolveKeyword(token_type, input + "
+                     "start_pos, end_pos - start_pos);\n";
+    string_stream << "    }\n\n";
+  }
+
+  string_stream << "    // Moves past the next token that is not skipped and "
+                   "stores its bounds.\n";
+  string_stream << "    // Returns its type, UNKNOWN_TOKEN for an unmatched "
+                   "byte or END_OF_INPUT.\n";
+  string_stream << "    uint32_t scanNext(size_t& start_pos, size_t& end_pos) "
+                   "{\n";
+  string_stream << "        while (position < length) {\n";
+  string_stream << "            start_pos = position;\n";
+  string_stream
+      << "            int token_type = matchToken(start_pos, end_pos);\n\n";
+  string_stream << "            if (token_type != NO_TOKEN) {\n";
+  string_stream << "                position = end_pos;\n";
+  string_stream << "                if (isSkippedToken(token_type)) "
+                   "continue;\n";
+  string_stream << "                return (uint32_t)token_type;\n";
+  string_stream << "            }\n\n";
+  string_stream << "            end_pos = position = start_pos + 1;\n";
+  string_stream << "            return UNKNOWN_TOKEN;\n";
+  string_stream << "        }\n";
+  string_stream << "        start_pos = end_pos = length;\n";
+  string_stream << "        return END_OF_INPUT;\n";
+  string_stream << "    }\n\n";
 
   string_stream << "public:\n";
   string_stream
-      << "    Scanner(const char* input) : input(input), position(0) {\n";
-  string_stream << "        length = strlen(input);\n";
+      << "    Scanner(const char* data) : input(data), position(0) {\n";
+  string_stream << "        length = strlen(data);\n";
   string_stream << "    }\n\n";
 
-  string_stream << "    Token getNextToken() {\n";
-  string_stream << "        while (position < length) {\n";
-  string_stream << "            size_t start_pos = position;\n";
-  string_stream << "            int current_state = " << start_state << ";\n";
-  string_stream << "            int last_accepting_state = -1;\n";
-  string_stream << "            size_t last_accepting_pos = position;\n\n";
+  if (options.sentinel) {
+    string_stream << "    // data[size] must be a readable zero byte, "
+                     "which ends every match\n";
+    string_stream << "    // without a bounds check\n";
+  }
+  string_stream << "    Scanner(const char* data, size_t size)\n";
+  string_stream << "        : input(data), position(0), length(size) {}\n\n";
 
-  string_stream << "            while (position < length) {\n";
-  string_stream << "                char c = input[position];\n";
-  string_stream << "                int next_state = "
-                   "TRANSITION_TABLE[current_state][(unsigned char)c];\n\n";
+  string_stream << "#ifdef LEXY_POSIX\n";
+  string_stream << "    // Scans a file in place through a read-only mapping, "
+                   "without copying it\n";
+  string_stream
+      << "    static Scanner fromFile(const std::string& path) {\n";
+  string_stream << "        std::shared_ptr<const MappedFile> file =\n";
+  string_stream << "            std::make_shared<const MappedFile>(path);\n";
+  string_stream << "        Scanner scanner(file->data(), file->size());\n";
+  string_stream << "        scanner.mapping = file;\n";
+  string_stream << "        return scanner;\n";
+  string_stream << "    }\n";
+  string_stream << "#endif\n\n";
 
-  string_stream << "                if (next_state == -1) break;\n\n";
+  string_stream << "    TokenView getNextTokenView() {\n";
+  string_stream << "        size_t start_pos, end_pos;\n";
+  string_stream << "        uint32_t type = scanNext(start_pos, end_pos);\n";
+  string_stream << "        return {type, start_pos, (uint32_t)(end_pos - "
+                   "start_pos)};\n";
+  string_stream << "    }\n\n";
 
-  string_stream << "                current_state = next_state;\n";
-  string_stream << "                position++;\n\n";
+  string_stream << "    // The lexeme of a token returned by this scanner, as "
+                   "a view into its input\n";
+  string_stream << "    std::string_view lexeme(const TokenView& token) const "
+                   "{\n";
+  string_stream << "        return std::string_view(input + token.offset, "
+                   "token.length);\n";
+  string_stream << "    }\n\n";
 
+  string_stream << "    // Scans up to max tokens into parallel arrays and "
+                   "returns how many were\n";
+  string_stream << "    // written, 0 once the input is exhausted. Unmatched "
+                   "bytes become\n";
+  string_stream << "    // UNKNOWN_TOKEN entries of length 1.\n";
+  string_stream << "    size_t scanBatch(uint32_t* types, uint64_t* offsets, "
+                   "uint32_t* lengths,\n";
+  string_stream << "                     size_t max) {\n";
+  string_stream << "        size_t count = 0;\n";
+  string_stream << "        while (count < max && position < length) {\n";
+  string_stream << "            size_t start_pos = position;\n";
+  string_stream << "            size_t end_pos;\n";
   string_stream
-      << "                if (ACCEPTING_STATES[current_state] != -1) {\n";
+      << "            int token_type = matchToken(start_pos, end_pos);\n\n";
+  string_stream << "            if (token_type == NO_TOKEN) {\n";
+  string_stream << "                token_type = (int)UNKNOWN_TOKEN;\n";
+  string_stream << "                end_pos = start_pos + 1;\n";
+  string_stream << "            }\n";
+  string_stream << "            position = end_pos;\n";
   string_stream
-      << "                    last_accepting_state = current_state;\n";
-  string_stream << "                    last_accepting_pos = position;\n";
-  string_stream << "                }\n";
-  string_stream << "            }\n\n";
+      << "            if (isSkippedToken(token_type)) continue;\n\n";
+  string_stream << "            types[count] = (uint32_t)token_type;\n";
+  string_stream << "            offsets[count] = start_pos;\n";
+  string_stream
+      << "            lengths[count] = (uint32_t)(end_pos - start_pos);\n";
+  string_stream << "            count++;\n";
+  string_stream << "        }\n";
+  string_stream << "        return count;\n";
+  string_stream << "    }\n\n";
 
-  string_stream << "            if (last_accepting_state != -1) {\n";
-  string_stream << "                position = last_accepting_pos;\n";
-  string_stream << "                int token_type = "
-                   "ACCEPTING_STATES[last_accepting_state];\n";
+  string_stream << "    // Replaces the contents of out with the next batch of "
+                   "at most max tokens\n";
+  string_stream << "    size_t scanBatch(TokenBuffer& out, size_t max = "
+                   "LEXY_BATCH_SIZE) {\n";
+  string_stream << "        out.resize(max);\n";
+  string_stream << "        size_t count = scanBatch(out.types.data(), "
+                   "out.offsets.data(),\n";
+  string_stream << "                                 out.lengths.data(), "
+                   "max);\n";
+  string_stream << "        out.resize(count);\n";
+  string_stream << "        return count;\n";
+  string_stream << "    }\n\n";
 
-  // Logic to skip whitespace if WHITESPACE token type is defined
-  string_stream << "                // If this is WHITESPACE, continue "
-                   "scanning (ignore it)\n";
-  string_stream << "                bool is_whitespace = false;\n";
-  for (Index i = 0; i < token_types.size(); i++) {
-    if (token_types[i] == "WHITESPACE") {
-      string_stream << "                if (token_type == " << i
-                    << ") { is_whitespace = true; }\n";
+  string_stream << "    // Appends every remaining token to out, "
+                   "LEXY_BATCH_SIZE tokens at a time\n";
+  string_stream << "    size_t tokenizeAll(TokenBuffer& out) {\n";
+  string_stream << "        size_t total = 0;\n";
+  string_stream << "        for (;;) {\n";
+  string_stream << "            size_t old_size = out.size();\n";
+  string_stream << "            out.resize(old_size + LEXY_BATCH_SIZE);\n";
+  string_stream << "            size_t count = scanBatch(out.types.data() + "
+                   "old_size,\n";
+  string_stream << "                                     out.offsets.data() + "
+                   "old_size,\n";
+  string_stream << "                                     out.lengths.data() + "
+                   "old_size,\n";
+  string_stream << "                                     LEXY_BATCH_SIZE);\n";
+  string_stream << "            out.resize(old_size + count);\n";
+  string_stream << "            total += count;\n";
+  string_stream << "            if (count < LEXY_BATCH_SIZE) return total;\n";
+  string_stream << "        }\n";
+  string_stream << "    }\n\n";
+
+  string_stream << "    // Like getNextTokenView, but copies the lexeme\n";
+  string_stream << "    Token getNextToken() {\n";
+  string_stream << "        size_t start_pos, end_pos;\n";
+  string_stream << "        uint32_t type = scanNext(start_pos, end_pos);\n";
+  string_stream << "        return {(int)type, std::string(input + start_pos, "
+                   "end_pos - start_pos)};\n";
+  string_stream << "    }\n";
+
+  string_stream << generateParallelTokenizer();
+  string_stream << generateInterleavedScanner(loop);
+  string_stream << generateFileScanner();
+  string_stream << "};\n";
+
+  return string_stream.str();
+}
+
+String CodeGenerator::generateTableMatcher(const DFA &dfa,
+                                           const MatchLoopOptions &loop) {
+  StringStream string_stream;
+
+  // Crossing a run or a chain at once would skip the (state, position) pairs
+  // that the linear-time memo has to record
+  Vector<RunState> run_states;
+  bool compare_chains = false;
+  if (!loop.linear) {
+    run_states = computeRunStates(dfa);
+    compare_chains = !computeLiteralChains(dfa).empty();
+  }
+
+  string_stream << generateMatchPrologue(loop) << "\n";
+
+  String transition = "            state_t next_state = "
+                      "TRANSITION_TABLE[current_state][CHAR_CLASS[(unsigned "
+                      "char)input[pos]]];\n";
+  string_stream << generateMatchLoop(transition, !run_states.empty(),
+                                     compare_chains, loop);
+  string_stream << generateMatchEpilogue(loop);
+
+  if (!run_states.empty())
+    string_stream << generateRunSkipper(run_states);
+  if (loop.linear)
+    string_stream << "    mutable FailureMemo failures;\n\n";
+
+  return string_stream.str();
+}
+
+// Emits the signature of matchToken and the walk's variables. The last
+// accepting state is only tracked when the walk may have to back up to it.
+String CodeGenerator::generateMatchPrologue(const MatchLoopOptions &loop) {
+  StringStream string_stream;
+
+  string_stream << "    // Runs the DFA from start_pos and returns the token "
+                   "type of the longest\n";
+  string_stream << "    // match, storing its end in end_pos, or NO_TOKEN if "
+                   "nothing matches.\n";
+  string_stream << "    int " << matcherName(loop)
+                << "(size_t start_pos, size_t& end_pos) const {\n";
+  string_stream << "        size_t pos = start_pos;\n";
+  string_stream << "        state_t current_state = START_STATE;\n";
+  if (!loop.backtrack_free) {
+    string_stream << "        state_t last_accepting_state = DEAD_STATE;\n";
+    string_stream << "        size_t last_accepting_pos = start_pos;\n";
+  }
+  if (loop.linear)
+    string_stream << "        failures.trail.clear();\n";
+
+  return string_stream.str();
+}
+
+String CodeGenerator::generateMatchEpilogue(const MatchLoopOptions &loop) {
+  StringStream string_stream;
+
+  if (loop.linear)
+    string_stream << "        failures.fail();\n\n";
+
+  if (loop.backtrack_free) {
+    string_stream << "        // No non-accepting state follows an accepting "
+                     "one, so the walk matched\n";
+    string_stream << "        // exactly when it stopped in an accepting "
+                     "state\n";
+    string_stream << "        if (current_state < FIRST_ACCEPTING_STATE) {\n";
+    string_stream << "            end_pos = start_pos;\n";
+    string_stream << "            return NO_TOKEN;\n";
+    string_stream << "        }\n";
+    string_stream << "        end_pos = pos;\n";
+    string_stream << "        return ACCEPTING_STATES[current_state];\n";
+  } else {
+    string_stream << "        end_pos = last_accepting_pos;\n";
+    string_stream << "        if (last_accepting_state == DEAD_STATE) return "
+                     "NO_TOKEN;\n";
+    string_stream
+        << "        return ACCEPTING_STATES[last_accepting_state];\n";
+  }
+  string_stream << "    }\n\n";
+
+  return string_stream.str();
+}
+
+// Emits the longest-match loop of matchToken around the statement that computes
+// next_state. In sentinel mode the zero byte after the input stops the walk,
+// so the loop has no bounds check and its body is repeated to cut the number
+// of backward branches.
+String CodeGenerator::generateMatchLoop(const String &transition,
+                                        bool skip_runs, bool compare_chains,
+                                        const MatchLoopOptions &loop) {
+  const int sentinel_unroll = 4;
+  StringStream step;
+
+  if (compare_chains) {
+    step << "            // Every state of a chain has one live byte, so the "
+            "walk either reads\n";
+    step << "            // the whole literal or dies inside it\n";
+    step << "            if (CHAIN_LENGTH[current_state]) {\n";
+    step << "                size_t chain_length = "
+            "CHAIN_LENGTH[current_state];\n";
+    step << "                if (pos + chain_length > length ||\n";
+    step << "                    memcmp(input + pos, CHAIN_BYTES + "
+            "CHAIN_OFFSET[current_state],\n";
+    step << "                           chain_length) != 0)\n";
+    step << "                    break;\n";
+    step << "                current_state = CHAIN_TARGET[current_state];\n";
+    step << "                pos += chain_length;\n";
+    if (!loop.backtrack_free) {
+      step << "                if (current_state >= FIRST_ACCEPTING_STATE) "
+              "{\n";
+      step << "                    last_accepting_state = current_state;\n";
+      step << "                    last_accepting_pos = pos;\n";
+      step << "                }\n";
+    }
+    step << "                continue;\n";
+    step << "            }\n\n";
+  }
+
+  if (loop.linear) {
+    step << "            // Stop where an earlier walk is known to have "
+            "failed\n";
+    step << "            if (current_state < FIRST_ACCEPTING_STATE) {\n";
+    step << "                if (failures.hasFailed(current_state, pos)) "
+            "break;\n";
+    step << "                failures.enter(current_state, pos);\n";
+    step << "            }\n\n";
+  }
+
+  step << transition;
+  step << "            if (next_state == DEAD_STATE) break;\n\n";
+
+  if (skip_runs) {
+    step << "            // A self-loop may start a long run that skipRun can "
+            "cross at once\n";
+    step << "            if (next_state == current_state)\n";
+    step << "                pos = skipRun(current_state, pos + 1) - 1;\n\n";
+  }
+
+  step << "            current_state = next_state;\n";
+  step << "            pos++;\n";
+  if (!loop.backtrack_free) {
+    step << "\n";
+    step << "            if (current_state >= FIRST_ACCEPTING_STATE) {\n";
+    step << "                last_accepting_state = current_state;\n";
+    step << "                last_accepting_pos = pos;\n";
+    if (loop.linear)
+      step << "                failures.trail.clear();\n";
+    step << "            }\n";
+  }
+
+  StringStream string_stream;
+  if (loop.sentinel) {
+    string_stream << "        // No state has a transition on the zero byte "
+                     "that follows the\n";
+    string_stream << "        // input, so the walk always dies there\n";
+    string_stream << "        for (;;) {\n";
+    for (int i = 0; i < sentinel_unroll; i++) {
+      // Each copy gets its own block so its declarations do not clash
+      string_stream << "            {\n";
+      String body = step.str();
+      for (Index begin = 0; begin < body.size();) {
+        Index end = body.find('\n', begin);
+        if (end != begin && body[begin] != '#')
+          string_stream << "    ";
+        string_stream << body.substr(begin, end - begin + 1);
+        begin = end + 1;
+      }
+      string_stream << "            }\n";
     }
+  } else {
+    string_stream << "        while (pos < length) {\n";
+    string_stream << step.str();
   }
-  string_stream << "                if (is_whitespace) continue;\n\n";
+  string_stream << "        }\n\n";
+
+  return string_stream.str();
+}
+
+// Emits the memo of the linear-time mode, after Reps, "Maximal-munch
+// tokenization in linear time" (TOPLAS 1998). A (state, position) pair is
+// recorded once a walk through it ends without reaching an accepting state;
+// any later walk that arrives there can stop at once, so every pair is
+// crossed at most once in a failing walk and tokenization is O(n). Only
+// non-accepting states, those below FIRST_ACCEPTING_STATE, are ever recorded.
+// Scanner::matchToken, each lane of scanInterleaved and StreamScanner keep a
+// memo of their own; the stream's is keyed by stream offset and drops the
+// pages behind the current token.
+String CodeGenerator::generateFailureMemo() {
+  StringStream string_stream;
+
+  string_stream << "// (state, position) pairs that reach no accepting state, "
+                   "FIRST_ACCEPTING_STATE\n";
+  string_stream << "// bits per position, in pages of LEXY_FAILED_PAGE_SIZE "
+                   "positions that are only\n";
+  string_stream << "// allocated once a failure inside them is recorded\n";
+  string_stream << "struct FailureMemo {\n";
+  string_stream << "    std::deque<std::vector<uint64_t>> pages;\n";
+  string_stream << "    // Page number of pages.front()\n";
+  string_stream << "    uint64_t first_page = 0;\n";
+  string_stream << "    // Non-accepting states the current walk entered "
+                   "since its last accepting\n";
+  string_stream << "    // one, the first at trail_start\n";
+  string_stream << "    std::vector<state_t> trail;\n";
+  string_stream << "    uint64_t trail_start = 0;\n\n";
+  string_stream << "    bool hasFailed(state_t state, uint64_t pos) const {\n";
+  string_stream << "        uint64_t page = pos / LEXY_FAILED_PAGE_SIZE;\n";
+  string_stream << "        if (page < first_page || page - first_page >= "
+                   "pages.size()) return false;\n";
+  string_stream << "        const std::vector<uint64_t>& bits = pages[page - "
+                   "first_page];\n";
+  string_stream << "        if (bits.empty()) return false;\n";
+  string_stream << "        uint64_t bit = (pos % LEXY_FAILED_PAGE_SIZE) * "
+                   "FIRST_ACCEPTING_STATE + state;\n";
+  string_stream << "        return (bits[bit / 64] >> (bit % 64)) & 1;\n";
+  string_stream << "    }\n\n";
+  string_stream << "    void enter(state_t state, uint64_t pos) {\n";
+  string_stream << "        if (trail.empty()) trail_start = pos;\n";
+  string_stream << "        trail.push_back(state);\n";
+  string_stream << "    }\n\n";
+  string_stream << "    // Records that no state on the trail reaches an "
+                   "accepting state from its\n";
+  string_stream << "    // position\n";
+  string_stream << "    void fail() {\n";
+  string_stream << "        for (size_t i = 0; i < trail.size(); i++) {\n";
+  string_stream << "            uint64_t pos = trail_start + i;\n";
+  string_stream << "            uint64_t page = pos / LEXY_FAILED_PAGE_SIZE;\n";
+  string_stream << "            if (page < first_page) continue;\n";
+  string_stream << "            if (page - first_page >= pages.size()) "
+                   "pages.resize(page - first_page + 1);\n";
+  string_stream << "            std::vector<uint64_t>& bits = pages[page - "
+                   "first_page];\n";
+  string_stream << "            if (bits.empty())\n";
+  string_stream << "                bits.resize((LEXY_FAILED_PAGE_SIZE * "
+                   "FIRST_ACCEPTING_STATE + 63) / 64);\n";
+  string_stream << "            uint64_t bit = (pos % LEXY_FAILED_PAGE_SIZE) * "
+                   "FIRST_ACCEPTING_STATE + trail[i];\n";
+  string_stream << "            bits[bit / 64] |= (uint64_t)1 << (bit % 64);\n";
+  string_stream << "        }\n";
+  string_stream << "        trail.clear();\n";
+  string_stream << "    }\n\n";
+  string_stream << "    // Frees the pages wholly before pos, which no later "
+                   "walk reaches\n";
+  string_stream << "    void forget(uint64_t pos) {\n";
+  string_stream << "        uint64_t page = pos / LEXY_FAILED_PAGE_SIZE;\n";
+  string_stream << "        if (page <= first_page) return;\n";
+  string_stream << "        pages.erase(pages.begin(), pages.begin() + "
+                   "std::min<uint64_t>(pages.size(), page - first_page));\n";
+  string_stream << "        first_page = page;\n";
+  string_stream << "    }\n";
+  string_stream << "};\n\n";
+
+  return string_stream.str();
+}
+
+// A state gets a SIMD kernel when at least half of its live bytes loop back to
+// it and the loop class is a few byte ranges, e.g. the tail of an identifier,
+// a digit run or a whitespace run.
+Vector<CodeGenerator::RunState>
+CodeGenerator::computeRunStates(const DFA &dfa) {
+  const Size max_loop_ranges = 4;
+  Vector<RunState> run_states;
+
+  for (const State &state : dfa.getStates()) {
+    StateID id = state.getID();
+    RunState run_state{id, {}};
+    int live_bytes = 0;
+    int loop_bytes = 0;
+
+    for (const ByteRange &range : computeByteRanges(dfa, id)) {
+      live_bytes += range.high - range.low + 1;
+      if (range.target == id) {
+        loop_bytes += range.high - range.low + 1;
+        run_state.loop_ranges.push_back(range);
+      }
+    }
+
+    if (loop_bytes > 0 && loop_bytes * 2 >= live_bytes &&
+        run_state.loop_ranges.size() <= max_loop_ranges)
+      run_states.push_back(run_state);
+  }
+
+  return run_states;
+}
+
+// A chain starts at a state with a single live byte that leads to another
+// state, and runs on through non-accepting states with a single live byte
+// each. Its bytes are a literal such as the tail of "println!", which the
+// table would otherwise walk one row per byte. Chains shorter than
+// min_chain_length bytes are not worth a memcmp.
+Vector<CodeGenerator::LiteralChain>
+CodeGenerator::computeLiteralChains(const DFA &dfa) {
+  const Size min_chain_length = 3;
+  const Size max_chain_length = 255;
+  Size num_states = dfa.getStates().size();
+
+  // The one live byte of each state and where it leads, or -1
+  Vector<int> single_byte(num_states, -1);
+  Vector<StateID> single_target(num_states, -1);
+  for (const State &state : dfa.getStates()) {
+    StateID id = state.getID();
+    Vector<ByteRange> ranges = computeByteRanges(dfa, id);
+    if (ranges.size() == 1 && ranges[0].low == ranges[0].high &&
+        ranges[0].target != id) {
+      single_byte[id] = ranges[0].low;
+      single_target[id] = ranges[0].target;
+    }
+  }
+
+  Vector<LiteralChain> chains;
+  for (StateID id = 0; id < static_cast<StateID>(num_states); id++) {
+    if (single_byte[id] == -1)
+      continue;
 
-  string_stream << "                std::string lexeme(input + start_pos, "
-                   "last_accepting_pos - start_pos);\n";
-  string_stream << "                return {token_type, lexeme};\n";
+    LiteralChain chain{id, "", -1};
+    Set<StateID> visited{id};
+    StateID current = id;
+    bool cycle = false;
+    do {
+      chain.bytes += static_cast<char>(single_byte[current]);
+      current = single_target[current];
+      if (!visited.insert(current).second) {
+        cycle = true;
+        break;
+      }
+    } while (chain.bytes.size() < max_chain_length &&
+             single_byte[current] != -1 && !dfa.isAccepting(current));
+
+    // A cycle of single-byte states never reaches an accepting state, and
+    // the table walk dies on it just as well
+    if (cycle || chain.bytes.size() < min_chain_length)
+      continue;
+
+    chain.target = current;
+    chains.push_back(chain);
+  }
+
+  return chains;
+}
+
+// Emits the chains as three per-state arrays, with the bytes of every chain
+// in one string. A chain that starts inside another is a suffix of it, so
+// its bytes are usually found there already.
+String CodeGenerator::generateLiteralChains(
+    const DFA &dfa, const Vector<LiteralChain> &chains) {
+  StringStream string_stream;
+  Size num_states = dfa.getStates().size();
+
+  String blob;
+  Vector<Size> offsets(num_states, 0);
+  Vector<Size> lengths(num_states, 0);
+  Vector<StateID> targets(num_states, 0);
+  for (const LiteralChain &chain : chains) {
+    Index offset = blob.find(chain.bytes);
+    if (offset == String::npos) {
+      offset = blob.size();
+      blob += chain.bytes;
+    }
+    offsets[chain.state] = offset;
+    lengths[chain.state] = chain.bytes.size();
+    targets[chain.state] = chain.target;
+  }
+
+  auto emitArray = [&](const String &type, const String &name,
+                       auto &&value) {
+    string_stream << "static const " << type << " " << name << "["
+                  << num_states << "] = {";
+    for (Index i = 0; i < num_states; i++) {
+      if (i % 16 == 0)
+        string_stream << "\n    ";
+      string_stream << value(i);
+      if (i < num_states - 1)
+        string_stream << (i % 16 == 15 ? "," : ", ");
+    }
+    string_stream << "\n};\n\n";
+  };
+
+  string_stream << "// Literal chains: from state s the DFA either reads the "
+                   "CHAIN_LENGTH[s] bytes\n";
+  string_stream << "// at CHAIN_BYTES + CHAIN_OFFSET[s] and ends in "
+                   "CHAIN_TARGET[s], or dies\n";
+  string_stream << "static const char CHAIN_BYTES[] = "
+                << cStringLiteral(blob) << ";\n\n";
+  emitArray("uint8_t", "CHAIN_LENGTH",
+            [&](Index i) { return std::to_string(lengths[i]); });
+  emitArray(cellType(blob.size()), "CHAIN_OFFSET",
+            [&](Index i) { return std::to_string(offsets[i]); });
+  emitArray("state_t", "CHAIN_TARGET",
+            [&](Index i) { return std::to_string(targets[i]); });
+
+  return string_stream.str();
+}
+
+// Emits skipRun, which crosses the self-loop of a run state 32 (AVX2) or 16
+// (SSE2) bytes at a time. Each loop range [low, high] is tested with one
+// subtraction and an unsigned compare: byte - low <= high - low.
+String CodeGenerator::generateRunSkipper(const Vector<RunState> &run_states) {
+  StringStream string_stream;
+
+  string_stream << "    // Returns the first position at or after pos whose "
+                   "byte leaves the\n";
+  string_stream << "    // self-loop of state, checking a whole vector of "
+                   "bytes per step. The\n";
+  string_stream << "    // last partial vector is left to the table.\n";
+  string_stream << "    size_t skipRun(state_t state, size_t pos) const {\n";
+  string_stream << "#if defined(__SSE2__)\n";
+  string_stream << "        switch (state) {\n";
+
+  for (const RunState &run_state : run_states) {
+    string_stream << "        case " << run_state.state << ": { // "
+                  << describeRanges(run_state.loop_ranges) << "\n";
+
+    string_stream << "#if defined(__AVX2__)\n";
+    string_stream << "            while (pos + 32 <= length) {\n";
+    string_stream << "                __m256i bytes = "
+                     "_mm256_loadu_si256((const __m256i*)(input + pos));\n";
+    string_stream << generateRunTest(run_state.loop_ranges, "_mm256_",
+                                     "__m256i");
+    string_stream << "                unsigned mask = "
+                     "~(unsigned)_mm256_movemask_epi8(in_run);\n";
+    string_stream << "                if (mask) return pos + "
+                     "__builtin_ctz(mask);\n";
+    string_stream << "                pos += 32;\n";
+    string_stream << "            }\n";
+    string_stream << "#endif\n";
+
+    string_stream << "            while (pos + 16 <= length) {\n";
+    string_stream << "                __m128i bytes = "
+                     "_mm_loadu_si128((const __m128i*)(input + pos));\n";
+    string_stream << generateRunTest(run_state.loop_ranges, "_mm_",
+                                     "__m128i");
+    string_stream << "                unsigned mask = "
+                     "~(unsigned)_mm_movemask_epi8(in_run) & 0xFFFF;\n";
+    string_stream << "                if (mask) return pos + "
+                     "__builtin_ctz(mask);\n";
+    string_stream << "                pos += 16;\n";
+    string_stream << "            }\n";
+    string_stream << "            return pos;\n";
+    string_stream << "        }\n";
+  }
+
+  string_stream << "        default:\n";
+  string_stream << "            return pos;\n";
+  string_stream << "        }\n";
+  string_stream << "#else\n";
+  string_stream << "        (void)state;\n";
+  string_stream << "        return pos;\n";
+  string_stream << "#endif\n";
+  string_stream << "    }\n\n";
+
+  return string_stream.str();
+}
+
+// Emits the statements that set in_run to 0xFF in every lane whose byte lies
+// in one of the ranges, for the intrinsic family given by prefix
+String CodeGenerator::generateRunTest(const Vector<ByteRange> &ranges,
+                                      const String &prefix,
+                                      const String &vector_type) {
+  StringStream string_stream;
+  String si = prefix == "_mm_" ? "si128" : "si256";
+
+  for (Index i = 0; i < ranges.size(); i++) {
+    const ByteRange &range = ranges[i];
+    String test;
+
+    if (range.low == range.high) {
+      test = prefix + "cmpeq_epi8(bytes, " + prefix + "set1_epi8((char)" +
+             std::to_string(range.low) + "))";
+    } else {
+      String offset = "offset" + std::to_string(i);
+      string_stream << "                " << vector_type << " " << offset
+                    << " = " << prefix << "sub_epi8(bytes, " << prefix
+                    << "set1_epi8((char)" << range.low << "));\n";
+      test = prefix + "cmpeq_epi8(" + prefix + "min_epu8(" + offset + ", " +
+             prefix + "set1_epi8((char)" +
+             std::to_string(range.high - range.low) + ")), " + offset + ")";
+    }
+
+    if (i == 0) {
+      string_stream << "                " << vector_type << " in_run = " << test
+                    << ";\n";
+    } else {
+      string_stream << "                in_run = " << prefix << "or_" << si
+                    << "(in_run, " << test << ");\n";
+    }
+  }
+
+  return string_stream.str();
+}
+
+// Describes byte ranges as a bracket expression for comments in generated code
+String CodeGenerator::describeRanges(const Vector<ByteRange> &ranges) {
+  auto describe = [](int byte) {
+    if (byte >= 33 && byte <= 126)
+      return String(1, static_cast<char>(byte));
+    char hex[8];
+    snprintf(hex, sizeof(hex), "\\x%02X", byte);
+    return String(hex);
+  };
+
+  String description = "[";
+  for (const ByteRange &range : ranges) {
+    description += describe(range.low);
+    if (range.high != range.low) {
+      description += '-';
+      description += describe(range.high);
+    }
+  }
+  return description + "]";
+}
+
+// Returns how many lanes the sheng state vector needs: 16 for a PSHUFB when
+// the states and the dead state fit in 16 bytes, 64 for an AVX-512 VBMI
+// permute up to 64, or 0 when the DFA is too large for either
+int CodeGenerator::shengWidth(const DFA &dfa) {
+  Size num_lanes = dfa.getStates().size() + 1;
+  if (num_lanes <= 16)
+    return 16;
+  if (num_lanes <= 64)
+    return 64;
+  return 0;
+}
+
+// Lane s of the mask of class k holds the state reached from s on class k.
+// The dead state maps to itself and unused lanes to the dead state, so a
+// shuffle never produces a state outside the DFA.
+String CodeGenerator::generateShengMasks(const DFA &dfa,
+                                         const Vector<int> &char_classes,
+                                         int width) {
+  StringStream string_stream;
+  Size num_states = dfa.getStates().size();
+  Vector<int> representatives = computeClassRepresentatives(char_classes);
+
+  string_stream << "alignas(" << width << ") static const uint8_t SHENG_MASKS["
+                << representatives.size() << "][" << width << "] = {\n";
+
+  for (Index k = 0; k < representatives.size(); k++) {
+    string_stream << "    {";
+    for (int lane = 0; lane < width; lane++) {
+      StateID next = -1;
+      if (lane < static_cast<int>(num_states))
+        next = dfa.getNextState(lane, static_cast<char>(representatives[k]));
+      string_stream << (next == -1 ? static_cast<int>(num_states) : next);
+      if (lane < width - 1)
+        string_stream << (lane % 16 == 15 ? ",\n     " : ", ");
+    }
+    string_stream << "}";
+    if (k < representatives.size() - 1)
+      string_stream << ",";
+    string_stream << "\n";
+  }
+
+  string_stream << "};\n\n";
+  return string_stream.str();
+}
+
+// Emits a matchToken that advances the DFA with one byte shuffle per input
+// byte, in the style of Sheng. The current state is broadcast to every lane,
+// so the shuffle of a class mask by the state vector is the next state again
+// broadcast. Without SSSE3 (16 lanes) or AVX-512 VBMI (64 lanes) the masks
+// are indexed as a transposed transition table.
+String CodeGenerator::generateShengMatcher(int width,
+                                           const MatchLoopOptions &loop) {
+  StringStream string_stream;
+  String guard = width == 16 ? "#if defined(__SSSE3__)\n"
+                              : "#if defined(__AVX512VBMI__)\n";
+
+  string_stream << generateMatchPrologue(loop);
+  string_stream << guard;
+  string_stream << "        // Every lane holds the current state; shuffling "
+                   "a class mask by it\n";
+  string_stream << "        // yields the next state, with no table load on "
+                   "the dependency chain\n";
+  if (width == 16)
+    string_stream << "        __m128i state = "
+                     "_mm_set1_epi8((char)START_STATE);\n";
+  else
+    string_stream << "        __m512i state = "
+                     "_mm512_set1_epi8((char)START_STATE);\n";
+  string_stream << "#endif\n\n";
+
+  StringStream transition;
+  transition << guard;
+  if (width == 16) {
+    transition << "            const __m128i* mask = (const "
+                  "__m128i*)SHENG_MASKS[CHAR_CLASS[(unsigned "
+                  "char)input[pos]]];\n";
+    transition << "            state = "
+                  "_mm_shuffle_epi8(_mm_load_si128(mask), state);\n";
+    transition << "            state_t next_state = "
+                  "(state_t)_mm_cvtsi128_si32(state);\n";
+  } else {
+    transition << "            const __m512i* mask = (const "
+                  "__m512i*)SHENG_MASKS[CHAR_CLASS[(unsigned "
+                  "char)input[pos]]];\n";
+    transition << "            state = _mm512_permutexvar_epi8(state, "
+                  "_mm512_load_si512(mask));\n";
+    transition << "            state_t next_state =\n";
+    transition << "                "
+                  "(state_t)_mm_cvtsi128_si32(_mm512_castsi512_si128("
+                  "state));\n";
+  }
+  transition << "#else\n";
+  transition << "            state_t next_state = "
+                "SHENG_MASKS[CHAR_CLASS[(unsigned "
+                "char)input[pos]]][current_state];\n";
+  transition << "#endif\n";
+  string_stream << generateMatchLoop(transition.str(), false, false, loop);
+  string_stream << generateMatchEpilogue(loop);
+
+  return string_stream.str();
+}
+
+// Each cell of the pair table holds the state reached after the two bytes of
+// a pair of classes. A pair whose walk does not simply continue holds
+// DEAD_STATE instead, and the matcher takes one step through
+// TRANSITION_TABLE: the walk dies on the first or second byte, or, when
+// the last accepting state is tracked, the middle state accepts and the
+// final one does not. Walks that die end there after that step, so token
+// ends cost one pair lookup and one or two single steps.
+String CodeGenerator::generatePairTable(const DFA &dfa,
+                                        const Vector<int> &char_classes,
+                                        bool backtrack_free) {
+  StringStream string_stream;
+  Size num_states = dfa.getStates().size();
+  Vector<int> representatives = computeClassRepresentatives(char_classes);
+  Size num_classes = representatives.size();
+
+  string_stream << "// Indexed by state and CHAR_CLASS[a] * " << num_classes
+                << " + CHAR_CLASS[b] for the byte pair ab;\n";
+  string_stream << "// DEAD_STATE means the pair needs a single step\n";
+  string_stream << "static const state_t PAIR_TABLE[" << num_states << "]["
+                << num_classes * num_classes << "] = {\n";
+
+  for (const State &state : dfa.getStates()) {
+    StateID from = state.getID();
+    string_stream << "    {";
+
+    for (Index pair = 0; pair < num_classes * num_classes; pair++) {
+      StateID middle = dfa.getNextState(
+          from, static_cast<char>(representatives[pair / num_classes]));
+      StateID next =
+          middle == -1
+              ? -1
+              : dfa.getNextState(middle, static_cast<char>(
+                                             representatives[pair %
+                                                             num_classes]));
+
+      if (next == -1 || (!backtrack_free && dfa.isAccepting(middle) &&
+                         !dfa.isAccepting(next)))
+        string_stream << num_states;
+      else
+        string_stream << next;
+
+      if (pair < num_classes * num_classes - 1)
+        string_stream << (pair % 16 == 15 ? ",\n     " : ", ");
+    }
+
+    string_stream << "}";
+    if (from < static_cast<int>(num_states) - 1)
+      string_stream << ",";
+    string_stream << "\n";
+  }
+
+  string_stream << "};\n\n";
+  return string_stream.str();
+}
+
+// Emits matchToken for the stride2 backend. The pair lookups of a walk form
+// half as long a chain of dependent loads as the table backend's; the class
+// lookups of both bytes do not depend on the state and overlap with it.
+String CodeGenerator::generateStride2Matcher(int num_classes,
+                                             const MatchLoopOptions &loop) {
+  StringStream string_stream;
+
+  string_stream << generateMatchPrologue(loop) << "\n";
+
+  String last_accepting;
+  if (!loop.backtrack_free) {
+    last_accepting = "                if (current_state >= "
+                     "FIRST_ACCEPTING_STATE) {\n"
+                     "                    last_accepting_state = "
+                     "current_state;\n"
+                     "                    last_accepting_pos = pos;\n"
+                     "                }\n";
+  }
+
+  string_stream << "        for (;;) {\n";
+  string_stream << "            // Two bytes per lookup while the pair table "
+                   "has the answer\n";
+  string_stream << "            while (pos + 1 < length) {\n";
+  string_stream << "                size_t pair = CHAR_CLASS[(unsigned "
+                   "char)input[pos]] * "
+                << num_classes << " +\n";
+  string_stream << "                              CHAR_CLASS[(unsigned "
+                   "char)input[pos + 1]];\n";
+  string_stream << "                state_t next_state = "
+                   "PAIR_TABLE[current_state][pair];\n";
+  string_stream << "                if (next_state == DEAD_STATE) break;\n";
+  string_stream << "                current_state = next_state;\n";
+  string_stream << "                pos += 2;\n";
+  string_stream << last_accepting;
   string_stream << "            }\n\n";
+  // The pair table declined: the walk ends within the pair, passes an
+  // accepting state in its middle, or has one byte left
+  string_stream << "            // The pair ends the walk, passes an accepting "
+                   "state or is cut short\n";
+  string_stream << "            // by the input, so its bytes go one at a "
+                   "time\n";
+  for (int step = 0; step < 2; step++) {
+    string_stream << "            if (pos >= length) break;\n";
+    string_stream << "            " << (step == 0 ? "state_t " : "")
+                  << "next_state = "
+                     "TRANSITION_TABLE[current_state][CHAR_CLASS[(unsigned "
+                     "char)input[pos]]];\n";
+    string_stream << "            if (next_state == DEAD_STATE) break;\n";
+    string_stream << "            current_state = next_state;\n";
+    string_stream << "            pos++;\n";
+    if (!loop.backtrack_free) {
+      string_stream << "            if (current_state >= "
+                       "FIRST_ACCEPTING_STATE) {\n";
+      string_stream << "                last_accepting_state = "
+                       "current_state;\n";
+      string_stream << "                last_accepting_pos = pos;\n";
+      string_stream << "            }\n";
+    }
+    if (step == 0)
+      string_stream << "\n";
+  }
+  string_stream << "        }\n\n";
 
-  string_stream << "            position = start_pos + 1;\n";
-  string_stream
-      << "            return {-2, std::string(1, input[start_pos])};\n";
+  string_stream << generateMatchEpilogue(loop);
+
+  return string_stream.str();
+}
+
+// Emits Scanner::scanInterleaved, which walks the DFA on several inputs at
+// once through TRANSITION_TABLE, whatever the backend. The lanes are kept as
+// arrays of LEXY_INTERLEAVE locals so the compiler can hold them in registers
+// and issue their table loads back to back.
+String CodeGenerator::generateInterleavedScanner(const MatchLoopOptions &loop) {
+  StringStream string_stream;
+
+  string_stream << "\n";
+  string_stream << "    // Tokenizes many small independent inputs, such as "
+                   "messages, into one\n";
+  string_stream << "    // TokenBuffer each, with the same tokens tokenizeAll "
+                   "would give. One walk\n";
+  string_stream << "    // is bound by the latency of its chain of "
+                   "TRANSITION_TABLE loads, since\n";
+  string_stream << "    // each state depends on the last. Here "
+                   "LEXY_INTERLEAVE walks on different\n";
+  string_stream << "    // inputs take one byte each per round, so their "
+                   "loads overlap. A lane\n";
+  string_stream << "    // whose input runs out takes the next one.\n";
+  string_stream << "    static void scanInterleaved(const std::string_view* "
+                   "streams, TokenBuffer* outs,\n";
+  string_stream << "                                size_t count) {\n";
+  string_stream << "        // Lane i walks input[i] up to end[i] for "
+                   "outs[index[i]], in state[i]\n";
+  string_stream << "        // at pos[i], in a token that began at start[i]\n";
+  string_stream << "        const char* input[LEXY_INTERLEAVE];\n";
+  string_stream << "        size_t end[LEXY_INTERLEAVE];\n";
+  string_stream << "        size_t index[LEXY_INTERLEAVE];\n";
+  string_stream << "        size_t start[LEXY_INTERLEAVE];\n";
+  string_stream << "        size_t pos[LEXY_INTERLEAVE];\n";
+  string_stream << "        state_t state[LEXY_INTERLEAVE];\n";
+  if (!loop.backtrack_free) {
+    string_stream << "        size_t last_accepting_pos[LEXY_INTERLEAVE];\n";
+    string_stream << "        state_t last_accepting_state[LEXY_INTERLEAVE];\n";
+  }
+  if (loop.linear)
+    string_stream << "        FailureMemo failures[LEXY_INTERLEAVE];\n";
+  string_stream << "        size_t next_stream = 0;\n\n";
+  string_stream << "        // Points lane i at the next input with any bytes "
+                   "in it\n";
+  string_stream << "        auto refill = [&](size_t i) {\n";
+  string_stream << "            while (next_stream < count) {\n";
+  string_stream << "                size_t stream = next_stream++;\n";
+  string_stream << "                outs[stream].clear();\n";
+  string_stream << "                if (streams[stream].empty()) continue;\n";
+  string_stream << "                input[i] = streams[stream].data();\n";
+  string_stream << "                end[i] = streams[stream].size();\n";
+  string_stream << "                index[i] = stream;\n";
+  string_stream << "                start[i] = 0;\n";
+  string_stream << "                pos[i] = 0;\n";
+  string_stream << "                state[i] = START_STATE;\n";
+  if (!loop.backtrack_free) {
+    string_stream << "                last_accepting_pos[i] = 0;\n";
+    string_stream << "                last_accepting_state[i] = DEAD_STATE;\n";
+  }
+  if (loop.linear)
+    string_stream << "                failures[i] = FailureMemo();\n";
+  string_stream << "                return true;\n";
+  string_stream << "            }\n";
+  string_stream << "            return false;\n";
+  string_stream << "        };\n\n";
+  string_stream << "        // Moves lane i to next_state, one byte on\n";
+  string_stream << "        auto advance = [&](size_t i, state_t next_state) "
+                   "{\n";
+  string_stream << "            state[i] = next_state;\n";
+  string_stream << "            pos[i]++;\n";
+  if (!loop.backtrack_free) {
+    string_stream << "            if (next_state >= FIRST_ACCEPTING_STATE) {\n";
+    string_stream << "                last_accepting_state[i] = next_state;\n";
+    string_stream << "                last_accepting_pos[i] = pos[i];\n";
+    if (loop.linear)
+      string_stream << "                failures[i].trail.clear();\n";
+    string_stream << "            }\n";
+  }
+  string_stream << "        };\n\n";
+
+  // Lane i may take a step from pos[i] unless its input is exhausted or,
+  // in linear-time mode, an earlier walk already failed from there
+  String can_step = "pos[i] < end[i]";
+  if (loop.linear) {
+    can_step += " && !stopped(i)";
+    string_stream << "        // Tells whether an earlier walk of lane i "
+                     "failed from its state and\n";
+    string_stream << "        // position, and records the pair on its trail "
+                     "if not\n";
+    string_stream << "        auto stopped = [&](size_t i) {\n";
+    string_stream << "            if (state[i] >= FIRST_ACCEPTING_STATE) "
+                     "return false;\n";
+    string_stream << "            if (failures[i].hasFailed(state[i], pos[i])) "
+                     "return true;\n";
+    string_stream << "            failures[i].enter(state[i], pos[i]);\n";
+    string_stream << "            return false;\n";
+    string_stream << "        };\n\n";
+  }
+
+  string_stream << "        // Emits the token of lane i's finished walk and "
+                   "starts the next walk,\n";
+  string_stream << "        // on a new input once this one is done. Returns "
+                   "false when no input\n";
+  string_stream << "        // is left for the lane.\n";
+  string_stream << "        auto finish = [&](size_t i) {\n";
+  if (loop.linear)
+    string_stream << "            failures[i].fail();\n";
+  if (loop.backtrack_free) {
+    string_stream << "            // No non-accepting state follows an "
+                     "accepting one, so the walk\n";
+    string_stream << "            // matched exactly when it stopped in an "
+                     "accepting state\n";
+    string_stream << "            size_t end_pos = pos[i];\n";
+    string_stream << "            int token_type;\n";
+    string_stream << "            if (state[i] < FIRST_ACCEPTING_STATE) {\n";
+    string_stream << "                token_type = (int)UNKNOWN_TOKEN;\n";
+    string_stream << "                end_pos = start[i] + 1;\n";
+    string_stream << "            } else {\n";
+    string_stream << "                token_type = "
+                     "ACCEPTING_STATES[state[i]];\n";
+  } else {
+    string_stream << "            size_t end_pos = last_accepting_pos[i];\n";
+    string_stream << "            int token_type;\n";
+    string_stream << "            if (last_accepting_state[i] == DEAD_STATE) "
+                     "{\n";
+    string_stream << "                token_type = (int)UNKNOWN_TOKEN;\n";
+    string_stream << "                end_pos = start[i] + 1;\n";
+    string_stream << "            } else {\n";
+    string_stream << "                token_type = "
+                     "ACCEPTING_STATES[last_accepting_state[i]];\n";
+  }
+  if (loop.keywords) {
+    string_stream << "                token_type = resolveKeyword(token_type, "
+                     "input[i] + start[i], end_pos - start[i]);\n";
+  }
+  string_stream << "            }\n";
+  string_stream << "            if (!isSkippedToken(token_type))\n";
+  string_stream << "                outs[index[i]].push((uint32_t)token_type, "
+                   "start[i],\n";
+  string_stream << "                                    (uint32_t)(end_pos - "
+                   "start[i]));\n\n";
+  string_stream << "            start[i] = end_pos;\n";
+  string_stream << "            pos[i] = end_pos;\n";
+  string_stream << "            state[i] = START_STATE;\n";
+  if (!loop.backtrack_free) {
+    string_stream << "            last_accepting_pos[i] = end_pos;\n";
+    string_stream << "            last_accepting_state[i] = DEAD_STATE;\n";
+  }
+  string_stream << "            return end_pos < end[i] || refill(i);\n";
+  string_stream << "        };\n\n";
+  string_stream << "        size_t active = 0;\n";
+  string_stream << "        while (active < LEXY_INTERLEAVE && "
+                   "refill(active)) active++;\n\n";
+  string_stream << "        // While every lane has an input, each round "
+                   "loads the next state of\n";
+  string_stream << "        // all lanes before acting on any of them\n";
+  string_stream << "        bool lockstep = active == LEXY_INTERLEAVE;\n";
+  string_stream << "        while (lockstep) {\n";
+  string_stream << "            state_t next[LEXY_INTERLEAVE];\n";
+  string_stream << "            for (size_t i = 0; i < LEXY_INTERLEAVE; i++) "
+                   "{\n";
+  string_stream << "                next[i] = " << can_step << "\n";
+  string_stream << "                    ? "
+                   "TRANSITION_TABLE[state[i]][CHAR_CLASS[(unsigned "
+                   "char)input[i][pos[i]]]]\n";
+  string_stream << "                    : DEAD_STATE;\n";
+  string_stream << "            }\n\n";
+  string_stream << "            for (size_t i = 0; i < LEXY_INTERLEAVE; i++) "
+                   "{\n";
+  string_stream << "                if (next[i] != DEAD_STATE) {\n";
+  string_stream << "                    advance(i, next[i]);\n";
+  string_stream << "                } else if (!finish(i)) {\n";
+  string_stream << "                    input[i] = nullptr;\n";
+  string_stream << "                    lockstep = false;\n";
+  string_stream << "                }\n";
+  string_stream << "            }\n";
+  string_stream << "        }\n\n";
+  string_stream << "        // The inputs left are already in lanes, so each "
+                   "lane runs to its end\n";
+  string_stream << "        for (size_t i = 0; i < active; i++) {\n";
+  string_stream << "            while (input[i]) {\n";
+  string_stream << "                state_t next_state = " << can_step << "\n";
+  string_stream << "                    ? "
+                   "TRANSITION_TABLE[state[i]][CHAR_CLASS[(unsigned "
+                   "char)input[i][pos[i]]]]\n";
+  string_stream << "                    : DEAD_STATE;\n";
+  string_stream << "                if (next_state != DEAD_STATE)\n";
+  string_stream << "                    advance(i, next_state);\n";
+  string_stream << "                else if (!finish(i))\n";
+  string_stream << "                    input[i] = nullptr;\n";
+  string_stream << "            }\n";
   string_stream << "        }\n";
-  string_stream << "        return {-1, \"\"};\n";
+  string_stream << "    }\n\n";
+  string_stream << "    // Same as above for inputs held in a vector; outs is "
+                   "resized to match\n";
+  string_stream << "    static void scanInterleaved(const "
+                   "std::vector<std::string_view>& streams,\n";
+  string_stream << "                                std::vector<TokenBuffer>& "
+                   "outs) {\n";
+  string_stream << "        outs.resize(streams.size());\n";
+  string_stream << "        scanInterleaved(streams.data(), outs.data(), "
+                   "streams.size());\n";
+  string_stream << "    }\n";
+
+  return string_stream.str();
+}
+
+// Emits Scanner::scanFiles, a work-stealing pool over a list of files.
+// Every file is written by exactly one thread into its own slot of the
+// result, so the results need no locking and come out in input order.
+String CodeGenerator::generateFileScanner() {
+  StringStream string_stream;
+
+  string_stream << "\n";
+  string_stream << "#if defined(LEXY_POSIX) && defined(LEXY_THREADS)\n";
+  string_stream << "    // Tokenizes each file on nthreads threads (0 means "
+                   "one per core) and\n";
+  string_stream << "    // returns the results in the order of paths. With "
+                   "keep_tokens false only\n";
+  string_stream << "    // the counts are kept, and each thread reuses one "
+                   "batch buffer. Files are\n";
+  string_stream << "    // dealt out largest first, one queue per thread; a "
+                   "thread whose queue is\n";
+  string_stream << "    // empty steals from the back of another's, where the "
+                   "smallest files are.\n";
+  string_stream << "    static std::vector<FileTokens> scanFiles(const "
+                   "std::vector<std::string>& paths,\n";
+  string_stream << "                                             unsigned "
+                   "nthreads = 0,\n";
+  string_stream << "                                             bool "
+                   "keep_tokens = true) {\n";
+  string_stream << "        if (nthreads == 0) nthreads = std::max(1u, "
+                   "std::thread::hardware_concurrency());\n";
+  string_stream << "        nthreads = (unsigned)std::max<size_t>(1, "
+                   "std::min<size_t>(nthreads, paths.size()));\n\n";
+  string_stream << "        std::vector<FileTokens> results(paths.size());\n";
+  string_stream << "        std::vector<std::pair<uint64_t, size_t>> "
+                   "by_size;\n";
+  string_stream << "        for (size_t i = 0; i < paths.size(); i++) {\n";
+  string_stream << "            struct stat info;\n";
+  string_stream << "            uint64_t size = stat(paths[i].c_str(), &info) "
+                   "== 0 ? (uint64_t)info.st_size : 0;\n";
+  string_stream << "            by_size.push_back({size, i});\n";
+  string_stream << "        }\n";
+  string_stream << "        std::sort(by_size.begin(), by_size.end(), "
+                   "std::greater<>());\n\n";
+  string_stream << "        struct WorkQueue {\n";
+  string_stream << "            std::mutex lock;\n";
+  string_stream << "            std::deque<size_t> files;\n";
+  string_stream << "        };\n";
+  string_stream << "        std::vector<WorkQueue> queues(nthreads);\n";
+  string_stream << "        for (size_t i = 0; i < by_size.size(); i++)\n";
+  string_stream << "            queues[i % "
+                   "nthreads].files.push_back(by_size[i].second);\n\n";
+  string_stream << "        // Takes the next file of queue self, or steals "
+                   "one\n";
+  string_stream << "        auto take = [&](unsigned self, size_t& file) {\n";
+  string_stream << "            for (unsigned k = 0; k < nthreads; k++) {\n";
+  string_stream << "                WorkQueue& queue = queues[(self + k) % "
+                   "nthreads];\n";
+  string_stream << "                std::lock_guard<std::mutex> "
+                   "guard(queue.lock);\n";
+  string_stream << "                if (queue.files.empty()) continue;\n";
+  string_stream << "                if (k == 0) {\n";
+  string_stream << "                    file = queue.files.front();\n";
+  string_stream << "                    queue.files.pop_front();\n";
+  string_stream << "                } else {\n";
+  string_stream << "                    file = queue.files.back();\n";
+  string_stream << "                    queue.files.pop_back();\n";
+  string_stream << "                }\n";
+  string_stream << "                return true;\n";
+  string_stream << "            }\n";
+  string_stream << "            return false;\n";
+  string_stream << "        };\n\n";
+  string_stream << "        auto work = [&](unsigned self) {\n";
+  string_stream << "            // Each thread has its own scanners and batch "
+                   "buffer; only the\n";
+  string_stream << "            // tables are shared, and they are read-only\n";
+  string_stream << "            TokenBuffer batch;\n";
+  string_stream << "            size_t file;\n";
+  string_stream << "            while (take(self, file)) {\n";
+  string_stream << "                FileTokens& result = results[file];\n";
+  string_stream << "                result.path = paths[file];\n";
+  string_stream << "                result.counts.assign(NO_TOKEN + 1, 0);\n";
+  string_stream << "                try {\n";
+  string_stream << "                    MappedFile mapping(paths[file]);\n";
+  string_stream << "                    Scanner scanner(mapping.data(), "
+                   "mapping.size());\n";
+  string_stream << "                    if (keep_tokens) {\n";
+  string_stream << "                        "
+                   "scanner.tokenizeAll(result.tokens);\n";
+  string_stream << "                        for (uint32_t type : "
+                   "result.tokens.types)\n";
+  string_stream << "                            result.counts[type < NO_TOKEN "
+                   "? type : NO_TOKEN]++;\n";
+  string_stream << "                    } else {\n";
+  string_stream << "                        while (scanner.scanBatch(batch) > "
+                   "0) {\n";
+  string_stream << "                            for (uint32_t type : "
+                   "batch.types)\n";
+  string_stream << "                                result.counts[type < "
+                   "NO_TOKEN ? type : NO_TOKEN]++;\n";
+  string_stream << "                        }\n";
+  string_stream << "                    }\n";
+  string_stream << "                } catch (const std::exception& e) {\n";
+  string_stream << "                    result.error = e.what();\n";
+  string_stream << "                }\n";
+  string_stream << "            }\n";
+  string_stream << "        };\n\n";
+  string_stream << "        std::vector<std::thread> workers;\n";
+  string_stream << "        for (unsigned i = 1; i < nthreads; i++) "
+                   "workers.emplace_back(work, i);\n";
+  string_stream << "        work(0);\n";
+  string_stream << "        for (std::thread& worker : workers) "
+                   "worker.join();\n";
+  string_stream << "        return results;\n";
+  string_stream << "    }\n";
+  string_stream << "#endif\n";
+
+  return string_stream.str();
+}
+
+String CodeGenerator::generateScanMain() {
+  StringStream string_stream;
+
+  string_stream << "\n";
+  string_stream << "#ifdef LEXY_SCAN_MAIN\n";
+  string_stream << "#if !defined(LEXY_POSIX) || !defined(LEXY_THREADS)\n";
+  string_stream << "#error \"LEXY_SCAN_MAIN needs Scanner::scanFiles, which "
+                   "needs POSIX and threads\"\n";
+  string_stream << "#endif\n";
+  string_stream << "// A command-line driver: tokenizes every regular file "
+                   "under the paths given\n";
+  string_stream << "// and prints the number of tokens of each type. -j sets "
+                   "the thread count and\n";
+  string_stream << "// -v also prints the count of every file.\n";
+  string_stream << "int main(int argc, char** argv) {\n";
+  string_stream << "    unsigned nthreads = 0;\n";
+  string_stream << "    bool verbose = false;\n";
+  string_stream << "    std::vector<std::string> paths;\n";
+  string_stream << "    for (int i = 1; i < argc; i++) {\n";
+  string_stream << "        std::string arg = argv[i];\n";
+  string_stream << "        if (arg == \"-j\" && i + 1 < argc) {\n";
+  string_stream << "            nthreads = (unsigned)std::stoul(argv[++i]);\n";
+  string_stream << "        } else if (arg == \"-v\") {\n";
+  string_stream << "            verbose = true;\n";
+  string_stream << "        } else if (std::filesystem::is_directory(arg)) {\n";
+  string_stream << "            for (const auto& entry : "
+                   "std::filesystem::recursive_directory_iterator(arg))\n";
+  string_stream << "                if (entry.is_regular_file()) "
+                   "paths.push_back(entry.path().string());\n";
+  string_stream << "        } else {\n";
+  string_stream << "            paths.push_back(arg);\n";
+  string_stream << "        }\n";
+  string_stream << "    }\n";
+  string_stream << "    if (paths.empty()) {\n";
+  string_stream << "        fprintf(stderr, \"Usage: %s [-j threads] [-v] "
+                   "file_or_directory...\\n\", argv[0]);\n";
+  string_stream << "        return 1;\n";
+  string_stream << "    }\n";
+  string_stream << "    std::sort(paths.begin(), paths.end());\n\n";
+  string_stream << "    std::vector<FileTokens> results = "
+                   "Scanner::scanFiles(paths, nthreads, false);\n";
+  string_stream << "    std::vector<uint64_t> totals(NO_TOKEN + 1, 0);\n";
+  string_stream << "    int status = 0;\n";
+  string_stream << "    for (const FileTokens& result : results) {\n";
+  string_stream << "        if (!result.error.empty()) {\n";
+  string_stream << "            fprintf(stderr, \"%s\\n\", "
+                   "result.error.c_str());\n";
+  string_stream << "            status = 1;\n";
+  string_stream << "            continue;\n";
+  string_stream << "        }\n";
+  string_stream << "        uint64_t count = 0;\n";
+  string_stream << "        for (size_t t = 0; t <= NO_TOKEN; t++) {\n";
+  string_stream << "            totals[t] += result.counts[t];\n";
+  string_stream << "            count += result.counts[t];\n";
+  string_stream << "        }\n";
+  string_stream << "        if (verbose) printf(\"%12llu %s\\n\", (unsigned "
+                   "long long)count, result.path.c_str());\n";
+  string_stream << "    }\n\n";
+  string_stream << "    for (size_t t = 0; t <= NO_TOKEN; t++) {\n";
+  string_stream << "        if (totals[t] == 0) continue;\n";
+  string_stream << "        printf(\"%12llu %s\\n\", (unsigned long "
+                   "long)totals[t],\n";
+  string_stream << "               t < NO_TOKEN ? TOKEN_NAMES[t] : "
+                   "\"UNKNOWN\");\n";
+  string_stream << "    }\n";
+  string_stream << "    return status;\n";
+  string_stream << "}\n";
+  string_stream << "#endif\n";
+
+  return string_stream.str();
+}
+
+String CodeGenerator::generateParallelTokenizer() {
+  StringStream string_stream;
+
+  string_stream << "\n";
+  string_stream << "#ifdef LEXY_THREADS\n";
+  string_stream << "private:\n";
+  string_stream << "    // Appends every token that starts in [from, until) "
+                   "to out, including\n";
+  string_stream << "    // skipped ones; the last token may run past until.\n";
+  string_stream << "    void scanRange(size_t from, size_t until, "
+                   "TokenBuffer& out) const {\n";
+  string_stream << "        size_t pos = from;\n";
+  string_stream << "        while (pos < until) {\n";
+  string_stream << "            size_t end_pos;\n";
+  string_stream << "            int token_type = matchToken(pos, end_pos);\n";
+  string_stream << "            if (token_type == NO_TOKEN) {\n";
+  string_stream << "                token_type = (int)UNKNOWN_TOKEN;\n";
+  string_stream << "                end_pos = pos + 1;\n";
+  string_stream << "            }\n";
+  string_stream << "            out.push((uint32_t)token_type, pos, "
+                   "(uint32_t)(end_pos - pos));\n";
+  string_stream << "            pos = end_pos;\n";
+  string_stream << "        }\n";
+  string_stream << "    }\n\n";
+  string_stream << "public:\n";
+  string_stream << "    // Tokenizes buf on nthreads threads (0 means one per "
+                   "core) and returns the\n";
+  string_stream << "    // same tokens as a single Scanner. Each thread scans "
+                   "one chunk as if a\n";
+  string_stream << "    // token started at its first byte. The seams are "
+                   "then repaired in order:\n";
+  string_stream << "    // scanning resumes from the last confirmed token "
+                   "boundary until it lands\n";
+  string_stream << "    // on a boundary the speculative scan also found, "
+                   "after which both agree.\n";
+  string_stream << "    // Specs that resynchronize on whitespace or newlines "
+                   "rescan only a token\n";
+  string_stream << "    // or two per seam.\n";
+  string_stream << "    static TokenBuffer parallelTokenize(const char* buf, "
+                   "size_t len, unsigned nthreads = 0) {\n";
+  string_stream << "        if (nthreads == 0) nthreads = std::max(1u, "
+                   "std::thread::hardware_concurrency());\n";
+  string_stream << "        size_t num_chunks = std::max<size_t>(1, "
+                   "std::min<size_t>(nthreads, len / "
+                   "LEXY_PARALLEL_MIN_CHUNK_SIZE));\n";
+  string_stream << "        size_t chunk_size = (len + num_chunks - 1) / "
+                   "num_chunks;\n\n";
+  string_stream << "        Scanner scanner(buf, len);\n";
+  string_stream << "        TokenBuffer result;\n";
+  string_stream << "        if (num_chunks == 1) {\n";
+  string_stream << "            scanner.tokenizeAll(result);\n";
+  string_stream << "            return result;\n";
+  string_stream << "        }\n\n";
+  string_stream << "        std::vector<TokenBuffer> "
+                   "speculative(num_chunks);\n";
+  string_stream << "        std::vector<std::thread> workers;\n";
+  string_stream << "        for (size_t i = 1; i < num_chunks; i++) {\n";
+  string_stream << "            workers.emplace_back([&, i]() {\n";
+  string_stream << "                // Each thread gets its own scanner, so "
+                   "any state a scanner\n";
+  string_stream << "                // keeps between matches stays "
+                   "thread-local\n";
+  string_stream << "                Scanner worker(buf, len);\n";
+  string_stream << "                size_t from = i * chunk_size;\n";
+  string_stream << "                worker.scanRange(from, std::min(len, "
+                   "from + chunk_size), speculative[i]);\n";
+  string_stream << "            });\n";
+  string_stream << "        }\n";
+  string_stream << "        scanner.scanRange(0, std::min(len, chunk_size), "
+                   "speculative[0]);\n";
+  string_stream << "        for (std::thread& worker : workers) "
+                   "worker.join();\n\n";
+  string_stream << "        size_t total = 0;\n";
+  string_stream << "        for (const TokenBuffer& tokens : speculative) "
+                   "total += tokens.size();\n";
+  string_stream << "        result.reserve(total);\n";
+  string_stream << "        size_t pos = 0;\n";
+  string_stream << "        for (size_t i = 0; i < num_chunks; i++) {\n";
+  string_stream << "            const TokenBuffer& tokens = speculative[i];\n";
+  string_stream << "            size_t chunk_end = std::min(len, (i + 1) * "
+                   "chunk_size);\n\n";
+  string_stream << "            while (pos < chunk_end) {\n";
+  string_stream << "                // Once pos is a boundary of the "
+                   "speculative scan, the rest of\n";
+  string_stream << "                // the chunk is confirmed\n";
+  string_stream << "                size_t first = "
+                   "std::lower_bound(tokens.offsets.begin(), "
+                   "tokens.offsets.end(), pos) - tokens.offsets.begin();\n";
+  string_stream << "                if (first < tokens.size() && "
+                   "tokens.offsets[first] == pos) {\n";
+  string_stream << "                    for (size_t k = first; k < "
+                   "tokens.size(); k++) {\n";
+  string_stream << "                        if "
+                   "(!isSkippedToken((int)tokens.types[k]))\n";
+  string_stream << "                            result.push(tokens.types[k], "
+                   "tokens.offsets[k], tokens.lengths[k]);\n";
+  string_stream << "                    }\n";
+  string_stream << "                    pos = tokens.offsets.back() + "
+                   "tokens.lengths.back();\n";
+  string_stream << "                    break;\n";
+  string_stream << "                }\n\n";
+  string_stream << "                // Otherwise rescan one token from the "
+                   "confirmed boundary\n";
+  string_stream << "                size_t end_pos;\n";
+  string_stream << "                int token_type = scanner.matchToken(pos, "
+                   "end_pos);\n";
+  string_stream << "                if (token_type == NO_TOKEN) {\n";
+  string_stream << "                    token_type = (int)UNKNOWN_TOKEN;\n";
+  string_stream << "                    end_pos = pos + 1;\n";
+  string_stream << "                }\n";
+  string_stream << "                if (!isSkippedToken(token_type))\n";
+  string_stream << "                    result.push((uint32_t)token_type, "
+                   "pos, (uint32_t)(end_pos - pos));\n";
+  string_stream << "                pos = end_pos;\n";
+  string_stream << "            }\n";
+  string_stream << "        }\n";
+  string_stream << "        return result;\n";
+  string_stream << "    }\n";
+  string_stream << "#endif\n";
+
+  return string_stream.str();
+}
+
+// StreamScanner always walks the tables, whatever the backend, because its
+// walk has to survive a refill in the middle of a token.
+String CodeGenerator::generateStreamScanner(const MatchLoopOptions &loop) {
+  StringStream string_stream;
+
+  string_stream << "\n";
+  string_stream << "#ifndef LEXY_STREAM_CHUNK_SIZE\n";
+  string_stream << "#define LEXY_STREAM_CHUNK_SIZE 65536\n";
+  string_stream << "#endif\n\n";
+  string_stream << "#ifndef LEXY_READ_AHEAD_DEPTH\n";
+  string_stream << "#define LEXY_READ_AHEAD_DEPTH 4\n";
+  string_stream << "#endif\n\n";
+  string_stream << "#if defined(LEXY_POSIX) && defined(LEXY_THREADS)\n";
+  string_stream << "// Reads a source ahead of the scanner on a background "
+                   "thread. The thread\n";
+  string_stream << "// fills a ring of LEXY_READ_AHEAD_DEPTH page-aligned "
+                   "blocks while the\n";
+  string_stream << "// scanner consumes the earlier ones, so the wait for the "
+                   "next read overlaps\n";
+  string_stream << "// with DFA work instead of adding to it. Pass it to "
+                   "StreamScanner::\n";
+  string_stream << "// fromReadAhead; the call operator has the "
+                   "StreamScanner::Refill signature.\n";
+  string_stream << "class ReadAhead {\n";
+  string_stream << "public:\n";
+  string_stream << "    // Copies up to capacity bytes at offset into dst, "
+                   "like pread(2), and\n";
+  string_stream << "    // returns how many were copied, or 0 at the end of "
+                   "the input.\n";
+  string_stream << "    typedef std::function<size_t(char* dst, size_t "
+                   "capacity, uint64_t offset)>\n";
+  string_stream << "        Read;\n\n";
+  string_stream << "private:\n";
+  string_stream << "    static constexpr size_t ALIGNMENT = 4096;\n\n";
+  string_stream << "    Read read;\n";
+  string_stream << "    size_t block_size;\n";
+  string_stream << "    std::unique_ptr<char, void (*)(void*)> memory;\n";
+  string_stream << "    std::vector<size_t> sizes;\n";
+  string_stream << "    // Blocks [head, tail) of the ring are full and "
+                   "belong to the consumer,\n";
+  string_stream << "    // the rest belong to the reader thread. head and "
+                   "tail only change under\n";
+  string_stream << "    // lock; ready is the consumer's last look at tail.\n";
+  string_stream << "    size_t head;\n";
+  string_stream << "    size_t tail;\n";
+  string_stream << "    size_t ready;\n";
+  string_stream << "    size_t used;\n";
+  string_stream << "    bool done;\n";
+  string_stream << "    bool stopping;\n";
+  string_stream << "    std::exception_ptr error;\n";
+  string_stream << "    std::mutex lock;\n";
+  string_stream << "    std::condition_variable filled;\n";
+  string_stream << "    std::condition_variable drained;\n";
+  string_stream << "    std::thread reader;\n\n";
+  string_stream << "    char* block(size_t i) {\n";
+  string_stream << "        return memory.get() + (i % sizes.size()) * "
+                   "block_size;\n";
+  string_stream << "    }\n\n";
+  string_stream << "    void run() {\n";
+  string_stream << "        uint64_t offset = 0;\n";
+  string_stream << "        for (;;) {\n";
+  string_stream << "            {\n";
+  string_stream << "                std::unique_lock<std::mutex> "
+                   "guard(lock);\n";
+  string_stream << "                drained.wait(guard, [&] {\n";
+  string_stream << "                    return stopping || tail - head < "
+                   "sizes.size();\n";
+  string_stream << "                });\n";
+  string_stream << "                if (stopping) return;\n";
+  string_stream << "            }\n\n";
+  string_stream << "            size_t count = 0;\n";
+  string_stream << "            std::exception_ptr failure;\n";
+  string_stream << "            try {\n";
+  string_stream << "                count = read(block(tail), block_size, "
+                   "offset);\n";
+  string_stream << "            } catch (...) {\n";
+  string_stream << "                failure = std::current_exception();\n";
+  string_stream << "            }\n\n";
+  string_stream << "            {\n";
+  string_stream << "                std::lock_guard<std::mutex> guard(lock);\n";
+  string_stream << "                if (count > 0) {\n";
+  string_stream << "                    sizes[tail % sizes.size()] = count;\n";
+  string_stream << "                    tail++;\n";
+  string_stream << "                } else {\n";
+  string_stream << "                    error = failure;\n";
+  string_stream << "                    done = true;\n";
+  string_stream << "                }\n";
+  string_stream << "            }\n";
+  string_stream << "            filled.notify_one();\n";
+  string_stream << "            if (count == 0) return;\n";
+  string_stream << "            offset += count;\n";
+  string_stream << "        }\n";
+  string_stream << "    }\n\n";
+  string_stream << "public:\n";
+  string_stream << "    ReadAhead(Read read_fn, size_t depth = "
+                   "LEXY_READ_AHEAD_DEPTH,\n";
+  string_stream << "              size_t block_bytes = "
+                   "LEXY_STREAM_CHUNK_SIZE)\n";
+  string_stream << "        : read(std::move(read_fn)),\n";
+  string_stream << "          block_size((block_bytes + ALIGNMENT - 1) / "
+                   "ALIGNMENT * ALIGNMENT),\n";
+  string_stream << "          memory(nullptr, free), sizes(depth < 2 ? 2 : "
+                   "depth), head(0),\n";
+  string_stream << "          tail(0), ready(0), used(0), done(false), "
+                   "stopping(false) {\n";
+  string_stream << "        memory.reset((char*)aligned_alloc(ALIGNMENT,\n";
+  string_stream << "                                          sizes.size() * "
+                   "block_size));\n";
+  string_stream << "        if (!memory) throw std::bad_alloc();\n";
+  string_stream << "        reader = std::thread(&ReadAhead::run, this);\n";
+  string_stream << "    }\n\n";
+  string_stream << "    ReadAhead(const ReadAhead&) = delete;\n";
+  string_stream << "    ReadAhead& operator=(const ReadAhead&) = delete;\n\n";
+  string_stream << "    ~ReadAhead() {\n";
+  string_stream << "        {\n";
+  string_stream << "            std::lock_guard<std::mutex> guard(lock);\n";
+  string_stream << "            stopping = true;\n";
+  string_stream << "        }\n";
+  string_stream << "        drained.notify_one();\n";
+  string_stream << "        reader.join();\n";
+  string_stream << "    }\n\n";
+  string_stream << "    // Reads a file descriptor with pread(2); the "
+                   "descriptor is not closed.\n";
+  string_stream << "    static std::shared_ptr<ReadAhead> fromFd(\n";
+  string_stream << "        int fd, size_t depth = LEXY_READ_AHEAD_DEPTH,\n";
+  string_stream << "        size_t block_bytes = LEXY_STREAM_CHUNK_SIZE) {\n";
+  string_stream << "#ifdef POSIX_FADV_SEQUENTIAL\n";
+  string_stream << "        posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);\n";
+  string_stream << "#endif\n";
+  string_stream << "        return std::make_shared<ReadAhead>(\n";
+  string_stream << "            [fd](char* dst, size_t capacity, uint64_t "
+                   "offset) -> size_t {\n";
+  string_stream << "                for (;;) {\n";
+  string_stream << "                    ssize_t count = pread(fd, dst, "
+                   "capacity, (off_t)offset);\n";
+  string_stream << "                    if (count >= 0) return "
+                   "(size_t)count;\n";
+  string_stream << "                    if (errno != EINTR)\n";
+  string_stream << "                        throw std::runtime_error(\n";
+  string_stream << "                            std::string(\"read failed: "
+                   "\") + strerror(errno));\n";
+  string_stream << "                }\n";
+  string_stream << "            },\n";
+  string_stream << "            depth, block_bytes);\n";
+  string_stream << "    }\n\n";
+  string_stream << "    // Copies out of the oldest full block, waiting for "
+                   "the reader if there\n";
+  string_stream << "    // is none yet. A read error is rethrown here once "
+                   "the blocks read before\n";
+  string_stream << "    // it have been handed out.\n";
+  string_stream << "    size_t operator()(char* dst, size_t capacity) {\n";
+  string_stream << "        if (head == ready) {\n";
+  string_stream << "            std::unique_lock<std::mutex> guard(lock);\n";
+  string_stream << "            filled.wait(guard, [&] { return head != tail "
+                   "|| done; });\n";
+  string_stream << "            ready = tail;\n";
+  string_stream << "            if (head == ready) {\n";
+  string_stream << "                if (error) "
+                   "std::rethrow_exception(error);\n";
+  string_stream << "                return 0;\n";
+  string_stream << "            }\n";
+  string_stream << "        }\n\n";
+  string_stream << "        size_t size = sizes[head % sizes.size()];\n";
+  string_stream << "        size_t count = std::min(capacity, size - used);\n";
+  string_stream << "        memcpy(dst, block(head) + used, count);\n";
+  string_stream << "        used += count;\n";
+  string_stream << "        if (used == size) {\n";
+  string_stream << "            used = 0;\n";
+  string_stream << "            {\n";
+  string_stream << "                std::lock_guard<std::mutex> guard(lock);\n";
+  string_stream << "                head++;\n";
+  string_stream << "            }\n";
+  string_stream << "            drained.notify_one();\n";
+  string_stream << "        }\n";
+  string_stream << "        return count;\n";
   string_stream << "    }\n";
   string_stream << "};\n";
+  string_stream << "#endif\n\n";
+  string_stream << "// A token returned by StreamScanner. offset counts from "
+                   "the start of the\n";
+  string_stream << "// stream; lexeme stays valid until the next call to "
+                   "StreamScanner::next.\n";
+  string_stream << "struct StreamToken {\n";
+  string_stream << "    uint32_t type;\n";
+  string_stream << "    uint64_t offset;\n";
+  string_stream << "    std::string_view lexeme;\n";
+  string_stream << "};\n\n";
+  string_stream << "// Scans input pulled in chunks from a refill callback, "
+                   "so memory is bounded by\n";
+  string_stream << "// the buffer size instead of the input size. The buffer "
+                   "holds the unfinished\n";
+  string_stream << "// tail of the previous chunk followed by the next one; a "
+                   "token that crosses a\n";
+  string_stream << "// chunk boundary keeps its DFA state and last accepting "
+                   "position and carries\n";
+  string_stream << "// on into the new chunk instead of being rescanned. The "
+                   "buffer only grows past\n";
+  string_stream << "// two chunks when a single token is longer than a "
+                   "chunk.\n";
+  string_stream << "class StreamScanner {\n";
+  string_stream << "public:\n";
+  string_stream << "    // Copies up to capacity bytes into dst and returns "
+                   "how many were copied,\n";
+  string_stream << "    // or 0 at the end of the input.\n";
+  string_stream << "    typedef std::function<size_t(char* dst, size_t "
+                   "capacity)> Refill;\n\n";
+  string_stream << "private:\n";
+  string_stream << "    Refill refill;\n";
+  string_stream << "    size_t chunk_size;\n";
+  string_stream << "    std::vector<char> buffer;\n";
+  string_stream << "    size_t begin;\n";
+  string_stream << "    size_t end;\n";
+  string_stream << "    uint64_t buffer_offset;\n";
+  string_stream << "    bool at_end;\n";
+  if (loop.linear)
+    string_stream << "    FailureMemo failures;\n";
+  string_stream << "\n";
+  string_stream << "    // Moves the unscanned tail [begin, end) to the front "
+                   "of the buffer and\n";
+  string_stream << "    // appends the next chunk. Returns false once the "
+                   "input is exhausted.\n";
+  string_stream << "    bool fill() {\n";
+  string_stream << "        if (at_end) return false;\n\n";
+  string_stream << "        if (begin > 0) {\n";
+  string_stream << "            memmove(buffer.data(), buffer.data() + begin, "
+                   "end - begin);\n";
+  string_stream << "            buffer_offset += begin;\n";
+  string_stream << "            end -= begin;\n";
+  string_stream << "            begin = 0;\n";
+  string_stream << "        }\n";
+  string_stream << "        if (buffer.size() - end < chunk_size) "
+                   "buffer.resize(end + chunk_size);\n\n";
+  string_stream << "        size_t count = refill(buffer.data() + end, "
+                   "chunk_size);\n";
+  string_stream << "        if (count == 0) {\n";
+  string_stream << "            at_end = true;\n";
+  string_stream << "            return false;\n";
+  string_stream << "        }\n";
+  string_stream << "        end += count;\n";
+  string_stream << "        return true;\n";
+  string_stream << "    }\n\n";
+  string_stream << "public:\n";
+  string_stream << "    StreamScanner(Refill refill_fn,\n";
+  string_stream << "                  size_t chunk_bytes = "
+                   "LEXY_STREAM_CHUNK_SIZE)\n";
+  string_stream << "        : refill(std::move(refill_fn)), "
+                   "chunk_size(chunk_bytes),\n";
+  string_stream << "          buffer(2 * chunk_bytes), begin(0), end(0), "
+                   "buffer_offset(0),\n";
+  string_stream << "          at_end(false) {}\n\n";
+  string_stream << "#ifdef LEXY_POSIX\n";
+  string_stream << "    // Streams from a file descriptor with read(2); the "
+                   "descriptor is not closed.\n";
+  string_stream << "    static StreamScanner fromFd(int fd, size_t chunk_bytes "
+                   "= LEXY_STREAM_CHUNK_SIZE) {\n";
+  string_stream << "        return StreamScanner([fd](char* dst, size_t "
+                   "capacity) -> size_t {\n";
+  string_stream << "            for (;;) {\n";
+  string_stream << "                ssize_t count = read(fd, dst, capacity);\n";
+  string_stream << "                if (count >= 0) return (size_t)count;\n";
+  string_stream << "                if (errno != EINTR)\n";
+  string_stream << "                    throw "
+                   "std::runtime_error(std::string(\"read failed: \") + "
+                   "strerror(errno));\n";
+  string_stream << "            }\n";
+  string_stream << "        }, chunk_bytes);\n";
+  string_stream << "    }\n";
+  string_stream << "#ifdef LEXY_THREADS\n";
+  string_stream << "\n";
+  string_stream << "    // Streams from a ReadAhead, whose thread reads the "
+                   "next blocks while this\n";
+  string_stream << "    // one scans. The scanner keeps the source alive.\n";
+  string_stream << "    static StreamScanner fromReadAhead(std::shared_ptr<"
+                   "ReadAhead> source,\n";
+  string_stream << "                                       size_t chunk_bytes "
+                   "= LEXY_STREAM_CHUNK_SIZE) {\n";
+  string_stream << "        return StreamScanner([source](char* dst, size_t "
+                   "capacity) {\n";
+  string_stream << "            return (*source)(dst, capacity);\n";
+  string_stream << "        }, chunk_bytes);\n";
+  string_stream << "    }\n";
+  string_stream << "#endif\n";
+  string_stream << "#endif\n\n";
+  string_stream << "    StreamToken next() {\n";
+  string_stream << "        for (;;) {\n";
+  string_stream << "            if (begin == end && !fill())\n";
+  string_stream << "                return {END_OF_INPUT, buffer_offset + "
+                   "end, std::string_view()};\n\n";
+  string_stream << "            size_t pos = begin;\n";
+  string_stream << "            state_t current_state = START_STATE;\n";
+  string_stream << "            state_t last_accepting_state = DEAD_STATE;\n";
+  string_stream << "            size_t last_accepting_pos = begin;\n";
+  if (loop.linear) {
+    string_stream << "            // No walk goes back before the start of "
+                     "this token\n";
+    string_stream << "            failures.forget(buffer_offset + begin);\n";
+    string_stream << "            failures.trail.clear();\n";
+  }
+  string_stream << "\n";
+  string_stream << "            for (;;) {\n";
+  string_stream << "                if (pos == end) {\n";
+  string_stream << "                    // The token may continue in the next "
+                   "chunk; fill() can\n";
+  string_stream << "                    // move it to the front of the "
+                   "buffer\n";
+  string_stream << "                    size_t old_begin = begin;\n";
+  string_stream << "                    bool more = fill();\n";
+  string_stream << "                    pos -= old_begin - begin;\n";
+  string_stream << "                    last_accepting_pos -= old_begin - "
+                   "begin;\n";
+  string_stream << "                    if (!more) break;\n";
+  string_stream << "                }\n\n";
+  if (loop.linear) {
+    string_stream << "                // Stop where an earlier walk is known "
+                     "to have failed\n";
+    string_stream << "                if (current_state < "
+                     "FIRST_ACCEPTING_STATE) {\n";
+    string_stream << "                    if (failures.hasFailed(current_state, "
+                     "buffer_offset + pos)) break;\n";
+    string_stream << "                    failures.enter(current_state, "
+                     "buffer_offset + pos);\n";
+    string_stream << "                }\n\n";
+  }
+  string_stream << "                state_t next_state = "
+                   "TRANSITION_TABLE[current_state][CHAR_CLASS[(unsigned "
+                   "char)buffer[pos]]];\n";
+  string_stream << "                if (next_state == DEAD_STATE) break;\n\n";
+  string_stream << "                current_state = next_state;\n";
+  string_stream << "                pos++;\n\n";
+  string_stream << "                if (current_state >= "
+                   "FIRST_ACCEPTING_STATE) {\n";
+  string_stream << "                    last_accepting_state = "
+                   "current_state;\n";
+  string_stream << "                    last_accepting_pos = pos;\n";
+  if (loop.linear)
+    string_stream << "                    failures.trail.clear();\n";
+  string_stream << "                }\n";
+  string_stream << "            }\n\n";
+  if (loop.linear)
+    string_stream << "            failures.fail();\n";
+  string_stream << "            size_t start_pos = begin;\n";
+  string_stream << "            if (last_accepting_state == DEAD_STATE) {\n";
+  string_stream << "                begin = start_pos + 1;\n";
+  string_stream << "                return {UNKNOWN_TOKEN, buffer_offset + "
+                   "start_pos,\n";
+  string_stream << "                        std::string_view(buffer.data() + "
+                   "start_pos, 1)};\n";
+  string_stream << "            }\n\n";
+  string_stream << "            begin = last_accepting_pos;\n";
+  string_stream << "            int token_type = "
+                   "ACCEPTING_STATES[last_accepting_state];\n";
+  if (loop.keywords)
+    string_stream << "            token_type = resolveKeyword(token_type, "
+                     "buffer.data() + start_pos, begin - start_pos);\n";
+  string_stream << "            if (isSkippedToken(token_type)) continue;\n\n";
+  string_stream << "            return {(uint32_t)token_type, buffer_offset + "
+                   "start_pos,\n";
+  string_stream << "                    std::string_view(buffer.data() + "
+                   "start_pos, begin - start_pos)};\n";
+  string_stream << "        }\n";
+  string_stream << "    }\n";
+  string_stream << "};\n";
+
+  return string_stream.str();
+}
+
+// Emits the DFA as straight-line code in the style of re2c: every state is a
+// label that records a match if it is accepting, then dispatches on the next
+// byte with range comparisons or, for busier states, a switch.
+String CodeGenerator::generateDirectMatcher(
+    const DFA &dfa, const UnorderedMap<String, int> &token_type_to_index,
+    const MatchLoopOptions &loop) {
+  StringStream string_stream;
+  StateID start_state = dfa.getStartStateID();
+
+  // Collapse each state's transitions into byte ranges, and remember which
+  // states are jumped to so that no unused label is emitted
+  Vector<Vector<ByteRange>> state_ranges;
+  Set<StateID> jump_targets;
+  for (const State &state : dfa.getStates()) {
+    state_ranges.push_back(computeByteRanges(dfa, state.getID()));
+    for (const ByteRange &range : state_ranges.back())
+      jump_targets.insert(range.target);
+  }
+
+  // Visit the start state first so the entry code falls through into it
+  StateIDs order{start_state};
+  for (const State &state : dfa.getStates()) {
+    if (state.getID() != start_state)
+      order.push_back(state.getID());
+  }
+
+  string_stream << "    // Runs the DFA from start_pos and returns the token "
+                   "type of the longest\n";
+  string_stream << "    // match, storing its end in end_pos, or NO_TOKEN if "
+                   "nothing matches.\n";
+  string_stream << "    int " << matcherName(loop)
+                << "(size_t start_pos, size_t& end_pos) const {\n";
+  string_stream << "        size_t pos = start_pos;\n";
+  if (!loop.backtrack_free) {
+    string_stream << "        int last_accepting_token = NO_TOKEN;\n";
+    string_stream << "        size_t last_accepting_pos = start_pos;\n";
+  }
+  string_stream << "        unsigned char c;\n";
+
+  // An accepting start state is only recorded when re-entered, never for the
+  // empty match at start_pos
+  bool start_accepting = dfa.isAccepting(start_state);
+  if (start_accepting)
+    string_stream << "        goto state_" << start_state << "_dispatch;\n";
+
+  for (StateID id : order) {
+    const Vector<ByteRange> &ranges = state_ranges[id];
+    string_stream << "\n";
+
+    if (jump_targets.count(id))
+      string_stream << "    state_" << id << ":\n";
+
+    // Without backtracking, an accepting state returns its own token when
+    // the walk stops in it, and every other stop is a failed match
+    bool returns_token = loop.backtrack_free && dfa.isAccepting(id);
+    String stop = "        goto done;\n";
+    String stop_after_byte = stop;
+
+    if (dfa.isAccepting(id)) {
+      String token_type = dfa.getTokenType(id);
+      auto it = token_type_to_index.find(token_type);
+      int token_index = (it != token_type_to_index.end()) ? it->second : 0;
+      if (returns_token) {
+        String token_return = "        return " +
+                              std::to_string(token_index) + "; // " +
+                              token_type + "\n";
+        stop = "        end_pos = pos;\n" + token_return;
+        stop_after_byte = "        end_pos = pos - 1;\n" + token_return;
+      } else {
+        string_stream << "        last_accepting_token = " << token_index
+                      << "; // " << token_type << "\n";
+        string_stream << "        last_accepting_pos = pos;\n";
+      }
+    }
+
+    if (id == start_state && start_accepting)
+      string_stream << "    state_" << id << "_dispatch:\n";
+
+    if (ranges.empty()) {
+      string_stream << stop;
+      continue;
+    }
+
+    // In sentinel mode the zero byte after the input stops the walk like any
+    // other byte without a transition
+    if (!loop.sentinel && returns_token) {
+      string_stream << "        if (pos >= length) {\n";
+      string_stream << "    " << stop.substr(0, stop.find('\n') + 1);
+      string_stream << "    " << stop.substr(stop.find('\n') + 1);
+      string_stream << "        }\n";
+    } else if (!loop.sentinel) {
+      string_stream << "        if (pos >= length) goto done;\n";
+    }
+    string_stream << "        c = (unsigned char)input[pos++];\n";
+
+    if (ranges.size() <= 4) {
+      for (const ByteRange &range : ranges) {
+        if (range.low == range.high) {
+          string_stream << "        if (c == " << byteLiteral(range.low)
+                        << ") goto state_" << range.target << ";\n";
+        } else {
+          string_stream << "        if (c >= " << byteLiteral(range.low)
+                        << " && c <= " << byteLiteral(range.high)
+                        << ") goto state_" << range.target << ";\n";
+        }
+      }
+      string_stream << stop_after_byte;
+      continue;
+    }
+
+    // Group the case labels by target, in order of first appearance
+    StateIDs targets;
+    for (const ByteRange &range : ranges) {
+      if (std::find(targets.begin(), targets.end(), range.target) ==
+          targets.end())
+        targets.push_back(range.target);
+    }
+
+    string_stream << "        switch (c) {\n";
+    for (StateID target : targets) {
+      int labels_on_line = 0;
+      for (const ByteRange &range : ranges) {
+        if (range.target != target)
+          continue;
+        for (int b = range.low; b <= range.high; b++) {
+          string_stream << (labels_on_line == 0 ? "        " : " ")
+                        << "case " << byteLiteral(b) << ":";
+          if (++labels_on_line == 8) {
+            string_stream << "\n";
+            labels_on_line = 0;
+          }
+        }
+      }
+      if (labels_on_line != 0)
+        string_stream << "\n";
+      string_stream << "            goto state_" << target << ";\n";
+    }
+    string_stream << "        default:\n";
+    string_stream << "            break;\n";
+    string_stream << "        }\n";
+    string_stream << stop_after_byte;
+  }
+
+  string_stream << "\n    done:\n";
+  if (loop.backtrack_free) {
+    string_stream << "        end_pos = start_pos;\n";
+    string_stream << "        return NO_TOKEN;\n";
+  } else {
+    string_stream << "        end_pos = last_accepting_pos;\n";
+    string_stream << "        return last_accepting_token;\n";
+  }
+  string_stream << "    }\n\n";
 
   return string_stream.str();
 }
+
+// Returns the live transitions of a state as maximal runs of consecutive bytes
+// sharing a target
+Vector<CodeGenerator::ByteRange>
+CodeGenerator::computeByteRanges(const DFA &dfa, StateID state) {
+  Vector<ByteRange> ranges;
+
+  for (int c = 0; c < 256; c++) {
+    StateID next = dfa.getNextState(state, static_cast<char>(c));
+    if (next == -1)
+      continue;
+
+    if (!ranges.empty() && ranges.back().high == c - 1 &&
+        ranges.back().target == next) {
+      ranges.back().high = c;
+    } else {
+      ranges.push_back({c, c, next});
+    }
+  }
+
+  return ranges;
+}
+
+// Prints a byte as a character literal when it is printable, otherwise as a
+// number
+String CodeGenerator::byteLiteral(int byte) {
+  if (byte == '\'' || byte == '\\')
+    return String("'\\") + static_cast<char>(byte) + "'";
+  if (byte >= 32 && byte <= 126)
+    return String("'") + static_cast<char>(byte) + "'";
+  return std::to_string(byte);
+}
@@ -1,17 +1,119 @@
 #pragma once
 
+#include "../automata/backtrack_analyzer.hpp"
 #include "../automata/dfa.hpp"
+#include "../automata/keyword_extractor.hpp"
 #include "../common/types.hpp"
 
+// How the generated scanner walks the DFA. TABLE indexes TRANSITION_TABLE on
+// every byte; DIRECT emits one label per state and dispatches on the byte in
+// code, which avoids the table load for small and medium DFAs. SHENG advances
+// DFAs of up to 63 states with one SIMD byte shuffle per input byte. STRIDE2
+// reads two bytes per lookup in a table indexed by pairs of byte classes.
+enum class Backend { TABLE, DIRECT, SHENG, STRIDE2 };
+
+struct GeneratorOptions {
+  Backend backend = Backend::TABLE;
+  // Expect a zero byte after the input and let it stop the DFA instead of
+  // checking the input length on every byte
+  bool sentinel = false;
+  // Memoize failed (state, position) pairs so that tokenization stays linear
+  // in the input length even for specs that backtrack
+  bool linear = false;
+};
+
 class CodeGenerator {
 public:
   static void generateScanner(const DFA &, const Vector<String> &,
-                              const String &);
+                              const String &,
+                              const GeneratorOptions & = GeneratorOptions{},
+                              const Vector<Keyword> & = Vector<Keyword>{});
 
 private:
-  static String generateTransitionTable(const DFA &);
+  struct ByteRange {
+    int low;
+    int high;
+    StateID target;
+  };
+
+  // How the table and sheng matchers emit their longest-match loop
+  struct MatchLoopOptions {
+    // A zero byte follows the input and stops the walk
+    bool sentinel;
+    // No failed walk can have passed an accepting state, so the last one
+    // need not be tracked
+    bool backtrack_free;
+    // Record failed (state, position) pairs and stop at known ones
+    bool linear;
+    // The DFA match is followed by a keyword lookup, so the backend emits it
+    // as matchLongest
+    bool keywords;
+  };
+
+  // A state whose self-loop covers most of its live bytes
+  struct RunState {
+    StateID state;
+    Vector<ByteRange> loop_ranges;
+  };
+
+  // A state from which the DFA either reads the bytes of a literal and ends
+  // in target, or dies
+  struct LiteralChain {
+    StateID state;
+    String bytes;
+    StateID target;
+  };
+
+  static void reportBacktracking(const BacktrackReport &);
+  static Size cellBytes(Size);
+  static String cellType(Size);
+  static String generateCellTypes(const DFA &, const Vector<String> &);
+  static Vector<int> computeCharClasses(const DFA &);
+  static Vector<int> computeClassRepresentatives(const Vector<int> &);
+  static String generateCharClassTable(const Vector<int> &);
+  static String generateTransitionTable(const DFA &, const Vector<int> &);
   static String generateAcceptingStates(const DFA &,
                                         const UnorderedMap<String, int> &);
   static String generateTokenNames(const Vector<String> &);
-  static String generateScannerClass(const DFA &, const Vector<String> &);
+  static bool buildKeywordHash(const Vector<Keyword> &, Size, Size,
+                               Vector<uint32_t> &, Vector<int> &);
+  static uint64_t keywordHash(const String &);
+  static Index keywordSlot(uint64_t, uint32_t, Size);
+  static String generateKeywordTable(const Vector<Keyword> &,
+                                     const UnorderedMap<String, int> &);
+  static String cStringLiteral(const String &);
+  static String matcherName(const MatchLoopOptions &);
+  static String generateScannerClass(const DFA &, const Vector<String> &,
+                                     const UnorderedMap<String, int> &,
+                                     const GeneratorOptions &,
+                                     const MatchLoopOptions &);
+  static String generateTableMatcher(const DFA &, const MatchLoopOptions &);
+  static String generateMatchPrologue(const MatchLoopOptions &);
+  static String generateMatchEpilogue(const MatchLoopOptions &);
+  static String generateMatchLoop(const String &, bool, bool,
+                                  const MatchLoopOptions &);
+  static String generateFailureMemo();
+  static Vector<RunState> computeRunStates(const DFA &);
+  static Vector<LiteralChain> computeLiteralChains(const DFA &);
+  static String generateLiteralChains(const DFA &,
+                                      const Vector<LiteralChain> &);
+  static String generateRunSkipper(const Vector<RunState> &);
+  static String generateRunTest(const Vector<ByteRange> &, const String &,
+                                const String &);
+  static String describeRanges(const Vector<ByteRange> &);
+  static String generateDirectMatcher(const DFA &,
+                                      const UnorderedMap<String, int> &,
+                                      const MatchLoopOptions &);
+  static int shengWidth(const DFA &);
+  static String generateShengMasks(const DFA &, const Vector<int> &, int);
+  static String generateShengMatcher(int, const MatchLoopOptions &);
+  static String generatePairTable(const DFA &, const Vector<int> &, bool);
+  static String generateStride2Matcher(int, const MatchLoopOptions &);
+  static String generateInterleavedScanner(const MatchLoopOptions &);
+  static String generateParallelTokenizer();
+  static String generateFileScanner();
+  static String generateScanMain();
+  static String generateStreamScanner(const MatchLoopOptions &);
+  static Vector<ByteRange> computeByteRanges(const DFA &, StateID);
+  static String byteLiteral(int);
 };
@@ -32,9 +32,6 @@ using Symbol = char;
 using Symbols = Vector<Symbol>;
 using Alphabet = Set<Symbol>;
 
-using Superstate = Set<StateID>;
-using Closure = Set<StateID>;
-
 using Lexeme = String;
 using Index = std::size_t;
 using Size = std::size_t;